@@ -0,0 +1,112 @@
+#ifndef NEURAL_ARENA_H
+#define NEURAL_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace neural {
+  /**
+   * A single contiguous block of memory that hands out aligned chunks with a bump pointer.
+   *
+   * Used to keep all parameters, per-neuron state and activation buffers of a Network
+   * close together, so that a forward or backward pass touches as few pages as possible.
+   * Where the platform supports it, the block is backed by huge pages (MAP_HUGETLB, falling
+   * back to madvise(MADV_HUGEPAGE), falling back to normal pages).
+   *
+   * Memory is only released when the Arena itself is destroyed. allocate() is not thread-safe,
+   * so fill the Arena before handing the Network to multiple threads.
+   */
+  class Arena {
+  public:
+    /**
+     * Reserve a new Arena
+     * @param capacity the number of bytes to reserve (rounded up to the page size)
+     * @param alignment every chunk returned by allocate() is aligned to this many bytes --
+     *   must be a power of two. Defaults to a typical cache line.
+     * @param huge_pages try to back the Arena with huge pages
+     */
+    Arena(size_t capacity, size_t alignment = 64, bool huge_pages = true);
+    ~Arena();
+
+    /**
+     * Get \p bytes bytes from the Arena, aligned to at least Alignment()
+     * @return a pointer into the Arena, or NULL if the Arena is exhausted
+     */
+    void* allocate(size_t bytes, size_t alignment = 0);
+
+    //! Check whether \p p points into this Arena
+    inline bool contains(const void* p) const {
+      return static_cast<const char*>(p) >= base && static_cast<const char*>(p) < base + capacity;
+    }
+
+    //! Round \p bytes up to the next multiple of Alignment()
+    inline size_t align(size_t bytes) const { return (bytes + alignment - 1) & ~(alignment - 1); }
+
+    inline size_t Capacity() const { return capacity; }
+    inline size_t Used() const { return used; }
+    inline size_t Alignment() const { return alignment; }
+
+    //! True if the Arena is backed by huge pages (explicitly or transparently)
+    inline bool HugePages() const { return huge; }
+  private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+    char* base;
+    size_t capacity;
+    size_t used;
+    size_t alignment;
+    bool huge;
+    //! true if base was obtained from mmap, false if it came from the heap
+    bool mapped;
+  };
+
+  /**
+   * A standard allocator that takes its memory from an Arena. Default-constructed instances
+   * (and instances whose Arena is exhausted) fall back to the regular heap, so containers using
+   * this allocator behave like ordinary std::vectors until they are explicitly moved into an Arena.
+   *
+   * Copying a container yields a heap-backed copy -- only moving one keeps it in the Arena.
+   */
+  template <class T>
+  class ArenaAllocator {
+  public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator() {}
+    explicit ArenaAllocator(std::shared_ptr<Arena> a) : arena(a) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+      if (arena) {
+	void* p = arena->allocate(n * sizeof(T), alignof(T));
+	if (p) return static_cast<T*>(p);
+      }
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t) {
+      // Arena memory is released all at once, together with the Arena
+      if (arena && arena->contains(p)) return;
+      ::operator delete(p);
+    }
+
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    std::shared_ptr<Arena> arena;
+  };
+
+  //! A std::vector that can be moved into an Arena
+  template <class T>
+  using arena_vector = std::vector<T, ArenaAllocator<T> >;
+}
+#endif
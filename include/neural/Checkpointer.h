@@ -0,0 +1,75 @@
+#ifndef NEURAL_CHECKPOINTER_H
+#define NEURAL_CHECKPOINTER_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Snapshot.h"
+
+using namespace std;
+
+namespace neural {
+  /**
+   * Writes checkpoints of a Network on a background thread, so training doesn't have to wait for the disk.
+   *
+   * save() only copies the weights into one of two Snapshot buffers and returns. A worker thread
+   * serializes the buffer in the Network::write() format, writes it to a temporary file, fsyncs
+   * it and atomically renames it to <tt>path.N</tt>, where N counts up from 1, or from the largest
+   * N already on disk. Only the most recent \p keep checkpoints are kept, including those left
+   * by a previous run.
+   *
+   * If save() is called again while the previous checkpoint is still being written, the
+   * pending (not yet started) checkpoint is replaced by the newer one.
+   */
+  class Checkpointer {
+  public:
+    /**
+     * Start a new Checkpointer
+     * @param path checkpoints are written to \p path.1, \p path.2, ...
+     * @param keep the number of checkpoints to keep, older ones are deleted
+     */
+    Checkpointer(const string &path, int keep = 3);
+
+    //! Write any pending checkpoint and stop the worker thread
+    ~Checkpointer();
+
+    //! Copy the current weights of \p net and queue them for writing
+    void save(const Network &net);
+
+    /**
+     * Block until all queued checkpoints have been written
+     * @return false if writing any checkpoint failed since the last call to wait()
+     */
+    bool wait();
+
+    //! Get the file name of the most recent checkpoint written successfully, or an empty string
+    string Latest();
+  private:
+    Checkpointer(const Checkpointer&);
+    Checkpointer& operator=(const Checkpointer&);
+    void work();
+    //! Get the sequence numbers N of all <tt>path.N</tt> files, in ascending order
+    static vector<unsigned long> existingCheckpoints(const string &path);
+
+    string path;
+    int keep;
+    Snapshot buffers[2];
+    //! Buffer the worker is currently writing
+    Snapshot* writing;
+    //! Buffer save() writes into
+    Snapshot* pending;
+    bool has_pending;
+    bool busy;
+    bool stopping;
+    bool failed;
+    unsigned long sequence;
+    deque<string> written;
+    mutex m;
+    condition_variable cv;
+    thread worker;
+  };
+}
+#endif
@@ -0,0 +1,87 @@
+#ifndef NEURAL_HALF_H
+#define NEURAL_HALF_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace neural {
+  /**
+   * Conversions between float and the two common 16 bit floating point formats:
+   * bfloat16 (8 exponent bits, 7 mantissa bits -- same range as float) and
+   * IEEE 754 half precision (5 exponent bits, 10 mantissa bits).
+   * Narrowing rounds to nearest, ties to even.
+   */
+  namespace half {
+    inline uint32_t floatBits(float f) {
+      uint32_t bits;
+      memcpy(&bits, &f, sizeof(bits));
+      return bits;
+    }
+
+    inline float bitsFloat(uint32_t bits) {
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      return f;
+    }
+
+    inline uint16_t toBFloat16(float f) {
+      uint32_t bits = floatBits(f);
+      if ((bits & 0x7FFFFFFF) > 0x7F800000) {
+	// NaN -- keep it a (quiet) NaN instead of rounding it to infinity
+	return (bits >> 16) | 0x0040;
+      }
+      return (bits + 0x7FFF + ((bits >> 16) & 1)) >> 16;
+    }
+
+    inline float fromBFloat16(uint16_t h) {
+      return bitsFloat(((uint32_t) h) << 16);
+    }
+
+    inline uint16_t toFloat16(float f) {
+      uint32_t bits = floatBits(f);
+      uint16_t sign = (bits >> 16) & 0x8000;
+      uint32_t abs = bits & 0x7FFFFFFF;
+      if (abs >= 0x7F800000) {
+	// Infinity or NaN
+	return sign | 0x7C00 | (abs > 0x7F800000 ? 0x0200 : 0);
+      }
+      if (abs >= 0x477FF000) {
+	// Rounds to something larger than 65504, the largest finite half
+	return sign | 0x7C00;
+      }
+      if (abs < 0x38800000) {
+	// Smaller than the smallest normal half (2^-14): result is subnormal or zero
+	int shift = 126 - (int) (abs >> 23);
+	if (shift > 24) return sign;
+	uint32_t mantissa = (abs & 0x007FFFFF) | 0x00800000;
+	uint32_t result = mantissa >> shift;
+	uint32_t rest = mantissa & ((1u << shift) - 1);
+	uint32_t halfway = 1u << (shift - 1);
+	if (rest > halfway || (rest == halfway && (result & 1))) {
+	  result++;
+	}
+	return sign | result;
+      }
+      // Re-bias the exponent from 127 to 15, then round away 13 mantissa bits
+      uint32_t rebiased = abs - 0x38000000;
+      return sign | ((rebiased + 0x0FFF + ((rebiased >> 13) & 1)) >> 13);
+    }
+
+    inline float fromFloat16(uint16_t h) {
+      uint32_t sign = ((uint32_t) (h & 0x8000)) << 16;
+      uint32_t exponent = (h >> 10) & 0x1F;
+      uint32_t mantissa = h & 0x03FF;
+      if (exponent == 0) {
+	// Zero or subnormal
+	float value = std::ldexp((float) mantissa, -24);
+	return sign ? -value : value;
+      }
+      if (exponent == 0x1F) {
+	return bitsFloat(sign | 0x7F800000 | (mantissa << 13));
+      }
+      return bitsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+  }
+}
+#endif
@@ -0,0 +1,75 @@
+#ifndef NEURAL_HALFNETWORK_H
+#define NEURAL_HALFNETWORK_H
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <string>
+#include <iostream>
+#include "Network.h"
+#include "Half.h"
+
+using namespace std;
+
+namespace neural {
+  /**
+   * An inference-only copy of a trained Network whose weights are stored as 16 bit floats
+   * (bfloat16 or IEEE half precision). This halves model size and memory traffic compared to
+   * float (a quarter compared to the double weights of Network) without any calibration.
+   *
+   * Weights are widened to float in registers while running; sums are accumulated in double,
+   * just like in Neuron::updateOutput().
+   */
+  class HalfNetwork {
+  public:
+    enum Format {
+      BFLOAT16,
+      FLOAT16
+    };
+
+    /**
+     * Convert a trained Network
+     * @param net the network to convert -- its activation functions are kept as they are
+     * @param format the 16 bit format to store the weights in
+     */
+    HalfNetwork(const Network &net, Format format = BFLOAT16);
+
+    /**
+     * De-serialize a HalfNetwork written by HalfNetwork::write(). As with Network::read(), activation
+     * functions aren't stored, so all neurons use tanh. Returns an empty HalfNetwork (0 layers) on error.
+     */
+    static HalfNetwork read(string &filename);
+    static HalfNetwork read(istream &s);
+
+    //! Run the network for the given input
+    vector<double> run(const vector<double> &input) const;
+
+    /**
+     * Serialize this network into \p s. The layout matches Network::write(), starting with
+     * a HALFNETWORK header and storing each Neuron's weights as a blob of 16 bit values.
+     */
+    bool write(ostream &s) const;
+    bool write(string &filename) const;
+
+    inline int Inputs() const { return input_count; };
+    inline int Outputs() const { return sizes.empty() ? 0 : sizes.back(); };
+    inline int Layers() const { return sizes.size(); };
+    inline Format getFormat() const { return format; };
+  private:
+    HalfNetwork(Format f, int inputs);
+    //! Run one layer, widening weights with \p widen
+    template <float (*widen)(uint16_t)>
+    static void runLayer(const uint16_t* w, const vector<double> &in, vector<double> &out,
+			 const std::function<double (double)>* activations);
+
+    Format format;
+    int input_count;
+    //! Number of neurons in each layer
+    vector<int> sizes;
+    //! All weights, in the order of Network::copyParameters()
+    vector<uint16_t> weights;
+    //! One activation function per neuron, across all layers
+    vector<std::function<double (double)> > activations;
+  };
+}
+#endif
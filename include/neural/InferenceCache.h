@@ -0,0 +1,94 @@
+#ifndef NEURAL_INFERENCECACHE_H
+#define NEURAL_INFERENCECACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace neural {
+  /**
+   * A bounded cache of network outputs by input, for workloads that run the same inputs over and over.
+   * Use it through Network::enableCache() rather than directly.
+   *
+   * Inputs are hashed either by their exact bytes or, if a quantum is given, after rounding each value
+   * to a multiple of the quantum (so inputs that differ by less than that share an entry). The cache
+   * is split into shards with their own lock and least-recently-used list, so concurrent callers rarely
+   * wait for each other. invalidate() drops all entries at once in O(1) -- entries are tagged with
+   * a generation number and entries of older generations are never returned.
+   */
+  class InferenceCache {
+  public:
+    /**
+     * Construct an empty cache
+     * @param capacity the maximum number of entries, spread evenly across the shards
+     * @param shards the number of independently locked shards
+     * @param quantum if greater than 0, inputs are rounded to multiples of this before hashing and comparing
+     */
+    InferenceCache(size_t capacity, int shards = 16, double quantum = 0.0);
+
+    /**
+     * Look up the output for \p input
+     * @return true (and the output in \p output) on a hit, false on a miss
+     */
+    bool lookup(const vector<double> &input, vector<double> &output);
+
+    /**
+     * Store \p output as the result for \p input, evicting the least recently used entry of its shard if necessary
+     * @param generation the Generation() read before \p output was computed -- if invalidate() has been
+     *   called since, \p output may come from old weights and isn't stored
+     */
+    void insert(const vector<double> &input, const vector<double> &output, unsigned long generation);
+
+    //! Drop all entries -- called by Network whenever its weights change
+    inline void invalidate() { generation++; };
+
+    //! Get the number of invalidate() calls so far
+    inline unsigned long Generation() const { return generation.load(); };
+
+    inline uint64_t Hits() const { return hits.load(); };
+    inline uint64_t Misses() const { return misses.load(); };
+    inline uint64_t Evictions() const { return evictions.load(); };
+
+    //! Get the number of entries currently stored, including invalidated ones that haven't been evicted yet
+    size_t Size() const;
+    inline size_t Capacity() const { return shard_capacity * shards.size(); };
+    inline double Quantum() const { return quantum; };
+  private:
+    InferenceCache(const InferenceCache&);
+    InferenceCache& operator=(const InferenceCache&);
+
+    struct Entry {
+      uint64_t hash;
+      unsigned long generation;
+      vector<uint64_t> key;
+      vector<double> output;
+    };
+
+    struct Shard {
+      mutable mutex m;
+      //! Most recently used entry first
+      list<Entry> lru;
+      unordered_map<uint64_t, list<Entry>::iterator> index;
+    };
+
+    //! Turn \p input into the words that are hashed and compared
+    void makeKey(const vector<double> &input, vector<uint64_t> &key) const;
+    static uint64_t hash(const vector<uint64_t> &key);
+    inline Shard& shardFor(uint64_t h) { return *shards[(h >> 32) % shards.size()]; };
+
+    vector<unique_ptr<Shard> > shards;
+    size_t shard_capacity;
+    double quantum;
+    atomic<unsigned long> generation;
+    atomic<uint64_t> hits;
+    atomic<uint64_t> misses;
+    atomic<uint64_t> evictions;
+  };
+}
+#endif
@@ -0,0 +1,80 @@
+#ifndef NEURAL_JOURNAL_H
+#define NEURAL_JOURNAL_H
+
+#include <string>
+#include <vector>
+#include "Network.h"
+
+using namespace std;
+
+namespace neural {
+  /**
+   * An append-only journal of weight changes, for taking frequent snapshots of a Network that is
+   * being trained online without rewriting the whole network every time.
+   *
+   * The journal consists of a full base snapshot (<tt>path.base.G</tt>, in the Network::write()
+   * format) and the journal file itself (<tt>path</tt>), which names the base generation G and
+   * is followed by one record per call to record(). A record only holds the neurons whose weights
+   * changed by more than Threshold() since they were last written; Layer::isDirty() is used to skip
+   * neurons that weren't touched at all. Every BaseInterval() records, the journal is compacted
+   * into a new base snapshot.
+   *
+   * Records end with a checksum, so a record torn by a crash is ignored by load().
+   */
+  class Journal {
+  public:
+    /**
+     * Open a journal
+     * @param path file name of the journal -- an existing journal there is replaced on the first record()
+     * @param threshold a neuron is only written if one of its weights changed by more than this
+     */
+    Journal(const string &path, double threshold = 0.0);
+
+    /**
+     * Append the changes of \p net since the last record to the journal. Writes a new base snapshot
+     * instead if there is none yet, \p net has a different shape, BaseInterval() records have been written,
+     * or the previous record failed to append (and may have left a partial record behind).
+     * @return the number of neurons written (or -1 on error)
+     */
+    int record(Network &net);
+
+    /**
+     * Write \p net as the new base snapshot and start a new, empty journal
+     * @return false if writing failed -- the previous base and journal stay valid in that case
+     */
+    bool compact(Network &net);
+
+    /**
+     * Rebuild a Network from a base snapshot and its journal
+     * @return the rebuilt Network, or an empty Network (0 inputs and outputs) on error
+     */
+    static Network load(const string &path);
+
+    //! Write a new base snapshot after this many records -- defaults to 1000
+    inline void setBaseInterval(int records) { base_interval = records < 1 ? 1 : records; };
+    inline int BaseInterval() const { return base_interval; };
+
+    inline double Threshold() const { return threshold; };
+
+    //! Get the generation of the current base snapshot (0 if none has been written yet)
+    inline unsigned long Generation() const { return generation; };
+
+    //! Get the number of records written since the current base snapshot
+    inline int Records() const { return records; };
+  private:
+    static string baseName(const string &path, unsigned long generation);
+    //! Read the base generation from the header of the journal \p s
+    static bool readHeader(istream &s, unsigned long &generation);
+
+    string path;
+    double threshold;
+    int base_interval;
+    unsigned long generation;
+    int records;
+    //! The last append failed -- the journal may end in a partial record, see record()
+    bool torn;
+    //! Weights as of the base snapshot plus all records, in the order of Network::copyParameters()
+    vector<double> reference;
+  };
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef NEURAL_KERNEL_H
+#define NEURAL_KERNEL_H
+
+#include <cstddef>
+#include <string>
+
+namespace neural {
+  /**
+   * Selects how the weighted sums of a Layer are computed -- the fastest choice depends on the
+   * layer's shape and on the machine, see Tuner.
+   */
+  struct KernelConfig {
+    enum Variant {
+      //! One Neuron at a time, one accumulator -- gives exactly the same results as Neuron::updateOutput()
+      SCALAR,
+      //! One Neuron at a time, four independent accumulators
+      UNROLLED,
+      //! Four Neurons at a time, sharing each input load; all samples of a batch reuse the same weights
+      BLOCKED
+    };
+
+    KernelConfig(Variant v = SCALAR, int t = 1) : variant(v), threads(t) {}
+
+    //! Format as e.g. "blocked:4"
+    std::string toString() const;
+
+    /**
+     * Parse a string created by toString() -- the ":threads" part is optional
+     * @return false if \p s isn't a valid configuration, leaving \p config untouched
+     */
+    static bool parse(const std::string &s, KernelConfig &config);
+
+    inline bool operator==(const KernelConfig &other) const {
+      return variant == other.variant && threads == other.threads;
+    }
+
+    Variant variant;
+    //! Number of threads to split the work across, including the calling thread -- the others come from a pool shared by all calls
+    int threads;
+  };
+
+  /**
+   * Compute the weighted sums (before activation) of a dense layer for a batch of inputs:
+   * <tt>out[b * rows + i] = w[i][cols] + sum_j(in[b * cols + j] * w[i][j])</tt>
+   *
+   * @param w one pointer per Neuron, each to \p cols input weights followed by the bias
+   * @param rows the number of Neurons
+   * @param cols the number of inputs
+   * @param in \p batch input vectors, one after the other
+   * @param batch the number of input vectors
+   * @param out room for \p batch * \p rows sums
+   * @param config the kernel variant and thread count to use
+   */
+  void denseKernel(const double* const* w, size_t rows, size_t cols,
+		   const double* in, size_t batch, double* out, const KernelConfig &config);
+}
+#endif
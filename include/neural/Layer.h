@@ -6,6 +6,7 @@
 #include <fstream>
 #include <iostream>
 #include "Neuron.h"
+#include "Kernel.h"
 
 using namespace std;
 
@@ -82,6 +83,55 @@ namespace neural {
      */
     void updateOutputs(vector<double> inputs);
 
+    /**
+     * Run this layer (and only this layer) for a batch of inputs, without touching the Neurons'
+     * outputs -- so this is safe to call from several threads at once.
+     * @param in \p batch input vectors of Inputs() values each, one after the other
+     * @param batch the number of input vectors
+     * @param out room for \p batch * size() values
+     */
+    void forwardBatch(const double* in, size_t batch, double* out) const;
+
+    /**
+     * Overwrite the weights (including the bias) of the i-th Neuron with the values \p w points to
+     */
+    void setWeights(int i, const double* w);
+
+    /**
+     * [Training] Back-propagate a batch through this layer (and only this layer) without touching
+     * the Neurons' deltas -- the batched counterpart of Layer::updateDeltas(). Safe to call from
+     * several threads at once, as long as each uses its own \p gradients.
+     * @param in the \p batch input vectors forwardBatch() was called with
+     * @param out the outputs forwardBatch() computed for \p in
+     * @param summed_weighed_deltas \p batch vectors of size() values, as for Layer::updateDeltas()
+     * @param batch the number of input vectors
+     * @param prev_deltas if not NULL, receives \p batch vectors of Inputs() summed weighed deltas for the previous layer
+     * @param gradients parameterCount() values the weight gradients of this batch are *added* to,
+     *   in the order of copyParameters() -- see applyGradients()
+     */
+    void backwardBatch(const double* in, const double* out, const double* summed_weighed_deltas, size_t batch,
+		       double* prev_deltas, double* gradients) const;
+
+    /**
+     * [Training] Add \p scale times \p gradients (as accumulated by backwardBatch()) to the weights
+     */
+    void applyGradients(const double* gradients, double scale);
+
+    /**
+     * Compute the weighted sums (before activation) for a batch of inputs with the given kernel configuration
+     * (see denseKernel())
+     */
+    void weightedSums(const double* in, size_t batch, double* out, const KernelConfig &config) const;
+
+    /**
+     * Use \p config whenever this layer runs \p batch or more inputs at once
+     * (until a configuration for a larger batch size takes over) -- see Network::tune()
+     */
+    void setKernel(size_t batch, const KernelConfig &config);
+
+    //! Get the kernel configuration used for running \p batch inputs at once
+    KernelConfig kernelFor(size_t batch) const;
+
     /**
      * [Training] Recursively calculate the deltas (i.e. weighted error values), moving 
      * from this layer to the input layer.
@@ -101,21 +151,63 @@ namespace neural {
     //! Get the number of Neurons in this layer
     inline int size() const { return neurons.size(); };
 
+    //! Get the number of inputs to each Neuron in this layer, not counting the bias
+    inline int Inputs() const { return input_count; };
+
+    //! Get the i-th Neuron in this layer
+    inline const Neuron& neuron(int i) const { return neurons[i]; };
+
+    //! Get the number of weights (including biases) in this layer
+    size_t parameterCount() const;
+
+    /**
+     * Copy all weights of this layer into \p dst, Neuron after Neuron, each with its bias last
+     * @param dst must have room for parameterCount() values
+     */
+    void copyParameters(double* dst) const;
+
+    /**
+     * Overwrite all weights of this layer with values from \p src, in the order of copyParameters()
+     * @param src must hold parameterCount() values
+     */
+    void loadParameters(const double* src);
+
     //! Serialize this layer into \p s
     bool write(ostream &s) const;
 
+    //! Write the header of a layer in the format of write(), to be followed by \p neurons Neurons
+    static bool writeHeader(ostream &s, int inputs, int neurons);
+
     /**
      * Get the current output vector. Note that output is *only* updated
      *  by Layer::updateOutput, **not** implicitly by using this function!
      */
-    inline vector<double> Output() { return output; };
+    inline vector<double> Output() { return vector<double>(output.begin(), output.end()); };
 
     /**
      * Get a shared_ptr to the following Layer
      */
     inline shared_ptr<Layer> nextLayer() const { return next; };
+
+    /**
+     * Check whether the weights of the i-th Neuron may have changed since clearDirty(i) was last called.
+     * All neurons start out dirty; every function that modifies weights marks the neurons it touched.
+     */
+    inline bool isDirty(int i) const { return dirty[i]; };
+
+    //! Mark the i-th Neuron as unchanged (see isDirty())
+    inline void clearDirty(int i) { dirty[i] = false; };
+
+    /**
+     * Move this Layer's neurons, their weights and the output buffer into \p arena.
+     * The Arena needs at least arenaBytes() of free space, anything that doesn't fit stays on the heap.
+     */
+    void relocate(shared_ptr<Arena> arena);
+
+    //! Get the number of bytes relocate() will take from \p arena
+    size_t arenaBytes(const Arena &arena) const;
   private:
-    vector<double> output;
+    arena_vector<double> output;
     void init_neurons(int neuron_count, int inputs);
 
     /**
@@ -124,10 +216,18 @@ namespace neural {
      */
     void init_neurons(vector<vector<double> > neuron_data);
     static vector<Neuron> readNeurons(istream &s, int count);
+    //! Point rows at the weights of each Neuron -- needed whenever the weights move to a new buffer
+    void updateRows();
+    //! Kernel configurations by minimum batch size, sorted by batch size
+    vector<pair<size_t, KernelConfig> > kernels;
     shared_ptr<Layer> prev;
     shared_ptr<Layer> next;
     int input_count;
-    vector<Neuron> neurons;
+    arena_vector<Neuron> neurons;
+    //! Pointers to the weights of each Neuron, as expected by denseKernel()
+    vector<const double*> rows;
+    //! One flag per Neuron, see isDirty()
+    vector<bool> dirty;
   };
 }
 #endif
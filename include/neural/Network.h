@@ -2,6 +2,7 @@
 #define NEURAL_NETWORK_H
 
 #include "Layer.h"
+#include "InferenceCache.h"
 #include <vector>
 #include <memory>
 #include <fstream>
@@ -32,14 +33,96 @@ namespace neural {
      */
     double trainSingle(vector<double> input, vector<double> expected_output, double learning_rate = 0.3);
 
-    //! Run the neural network for the given input
+    /**
+     * Train the net with a single test case, without running it again after the update
+     * @param learning_rate controls the speed of learning (see Neuron::updateWeights() )
+     * @return the error for this case *before* back propagation -- unlike trainSingle(), this
+     *   costs no additional forward pass
+     */
+    double trainStep(const vector<double> &input, const vector<double> &expected_output, double learning_rate = 0.3);
+
+    /**
+     * Run the neural network for the given input. With a cache enabled (see enableCache()), results
+     * for inputs seen before are returned from the cache, Output() isn't updated, and run() is safe to
+     * call from several threads at once (as long as nobody is training the network).
+     */
     vector<double> run(vector<double> input);
+
+    /**
+     * Run the neural network for a batch of inputs. Unlike run(), this doesn't update Output(),
+     * so it is safe to call from several threads at once (as long as nobody is training the network).
+     * @return one output vector per input vector
+     */
+    vector<vector<double> > runBatch(const vector<vector<double> > &inputs) const;
+
+    /**
+     * Pick the fastest kernel configuration for each layer when running \p batch inputs at once
+     * (use 1 for run() and trainSingle()). Each layer shape is benchmarked only the first time it is
+     * seen on this machine, after that the result is read from a tuning file. See Tuner for the
+     * environment variables controlling this.
+     */
+    void tune(size_t batch = 1);
     inline int Layers() const { return layerCount; };
     inline int Inputs() const { return inputLayer.size(); };
     inline int Outputs() const { return outputLayer->size(); };
     inline vector<double> Output() const { return outputLayer->Output(); };
     bool write(string &filename) const;
     bool write(ostream &s) const;
+
+    //! Write the header of a network in the format of write(), to be followed by \p layers Layers
+    static bool writeHeader(ostream &s, int inputs, int layers);
+
+    /**
+     * Move all weights, per-neuron state and activation buffers of this Network into a
+     * single Arena, preferably backed by huge pages. Large networks otherwise spread over
+     * thousands of small heap allocations, which costs TLB misses on every pass.
+     * @param huge_pages try to back the Arena with huge pages, falling back to normal pages
+     * @param alignment alignment (in bytes, power of two) of every buffer placed in the Arena
+     * @return true if everything fit into the Arena
+     */
+    bool useArena(bool huge_pages = true, size_t alignment = 64);
+
+    //! Get the Arena holding this Network's data, or an empty pointer if useArena() wasn't called
+    inline shared_ptr<Arena> getArena() const { return arena; };
+
+    //! Get the first Layer after the input -- follow Layer::nextLayer() from there to reach the output layer
+    inline shared_ptr<Layer> firstLayer() const { return firstHidden ? firstHidden : outputLayer; };
+
+    //! Get the total number of weights (including biases) in this Network
+    size_t parameterCount() const;
+
+    /**
+     * Copy all weights of this Network into \p dst, layer by layer (see Layer::copyParameters())
+     * @param dst must have room for parameterCount() values
+     */
+    void copyParameters(double* dst) const;
+
+    /**
+     * Overwrite all weights of this Network with values from \p src, in the order of copyParameters()
+     * @param src must hold parameterCount() values
+     */
+    void loadParameters(const double* src);
+
+    /**
+     * [Training] Add \p scale times \p gradients to all weights, layer by layer (see Layer::applyGradients())
+     * @param gradients must hold parameterCount() values, in the order of copyParameters()
+     */
+    void applyGradients(const double* gradients, double scale);
+
+    /**
+     * Put a bounded least-recently-used cache in front of run(), for workloads that see the same inputs
+     * over and over. The cache is emptied whenever the weights are changed through this Network
+     * (training, loadParameters(), applyGradients()). Networks returned by read() start without a cache.
+     * @param capacity the maximum number of cached outputs
+     * @param shards the number of independently locked parts of the cache, for concurrent callers
+     * @param quantum if greater than 0, inputs are rounded to multiples of this before looking them up,
+     *   so nearly identical inputs share one entry -- by default, only identical inputs do
+     */
+    void enableCache(size_t capacity, int shards = 16, double quantum = 0.0);
+    inline void disableCache() { cache.reset(); };
+
+    //! Get the cache in front of run() (for its hit and miss counters), or an empty pointer if there is none
+    inline shared_ptr<InferenceCache> getCache() const { return cache; };
   private:
     Network(int input, shared_ptr<Layer> hidden, shared_ptr<Layer> output);
     int layerCount;
@@ -48,7 +131,10 @@ namespace neural {
     // Layers in between are accessed via prev and next pointers
     shared_ptr<Layer> firstHidden;
     shared_ptr<Layer> outputLayer;
-    double calculateError();
+    shared_ptr<Arena> arena;
+    shared_ptr<InferenceCache> cache;
+    //! Get the mean squared error of the current output
+    double calculateError(const vector<double> &expected_output) const;
   };
 }
 
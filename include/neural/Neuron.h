@@ -2,12 +2,14 @@
 #define NEURAL_NEURON_H
 
 #include <vector>
+#include <algorithm>
 #include <functional>
 #include <cmath>
 #include <fstream>
 #include <iostream>
 
 #include "Activation.h"
+#include "Arena.h"
 
 namespace neural {
   /**
@@ -65,6 +67,12 @@ namespace neural {
      */
     void updateOutput(std::vector<double> inputs);
 
+    /**
+     * Set this Neuron's output value from an already computed weighted sum of its inputs (including the bias)
+     * @param weighted_sum the value to pass through the activation function
+     */
+    inline void activate(double weighted_sum) { output = activationFunction(weighted_sum); }
+
     /**
      * Get the current output value -- this is only updated by Neuron::updateOutput(), *not* automatically!
      */
@@ -97,6 +105,18 @@ namespace neural {
      * Get the number of input weights for this Neuron -- this is equal to the number of neurons in the previous layer
      */
     inline int InputSize() { return weights.size() - 1; };
+
+    //! Get this Neuron's weights -- the last one is the bias weight
+    inline const arena_vector<double>& Weights() const { return weights; };
+
+    //! Overwrite this Neuron's weights (including the bias) with the values \p w points to
+    inline void setWeights(const double* w) { std::copy(w, w + weights.size(), weights.begin()); };
+
+    //! Get the activation function
+    inline const std::function<double (double)>& Activation() const { return activationFunction; };
+
+    //! Get the derivative of the activation function (see Neuron::Neuron())
+    inline const std::function<double (double)>& Derivative() const { return derivFunction; };
     
     /**
      * Update the weights using the delta calculated with Neuron::updateDelta()
@@ -107,6 +127,13 @@ namespace neural {
      */
     void updateWeights(std::vector<double> input, double learning_rate);
 
+    /**
+     * Add \p scale times \p gradients to the weights -- the batched counterpart of Neuron::updateWeights()
+     * @param gradients one value per weight (including the bias), pointing in the direction the weights should move
+     * @param scale typically the learning rate divided by the number of accumulated training cases
+     */
+    void applyGradients(const double* gradients, double scale);
+
     /**
      * Write this Neuron's data to an output stream. Size is written in ASCII, weights 
      * are stored as a binary blob -- the activation function isn't saved at all!
@@ -115,6 +142,22 @@ namespace neural {
      */
     bool write(std::ostream &s) const;
 
+    /**
+     * Write a Neuron in the format of write() from raw weights -- for copies of a Network's weights
+     * (Snapshot, HalfNetwork) that don't keep Neuron objects around
+     * @param weights \p size weights (including the bias) of \p weight_bytes bytes each
+     */
+    static bool write(std::ostream &s, const void* weights, size_t size, size_t weight_bytes);
+
+    /**
+     * Move this Neuron's weights into the memory handed out by \p alloc
+     * @param alloc an allocator taking its memory from an Arena
+     */
+    void relocate(const ArenaAllocator<double> &alloc);
+
+    //! Get the number of bytes relocate() will take from an Arena
+    size_t arenaBytes(const Arena &arena) const;
+
   protected:
     /**
      * Initialize this Neuron's weights to random values between -0.5 and 0.5 -- there will be one more 
@@ -130,7 +173,7 @@ namespace neural {
     std::function<double (double)> activationFunction;
     std::function<double (double)> derivFunction;
     //! Size will be inputSize + 1 -- the additional item is the bias
-    std::vector<double> weights;
+    arena_vector<double> weights;
     double output;
     double delta;
   };
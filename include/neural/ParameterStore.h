@@ -0,0 +1,89 @@
+#ifndef NEURAL_PARAMETERSTORE_H
+#define NEURAL_PARAMETERSTORE_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "Snapshot.h"
+
+using namespace std;
+
+namespace neural {
+  /**
+   * A versioned, RCU-style store of Network weights, for serving a model while it is being trained.
+   *
+   * The trainer keeps training its own Network (e.g. with Network::trainSingle()) and calls
+   * publish() every now and then. This copies the weights into a new Snapshot and swaps it in
+   * atomically. Readers pin() the current Snapshot without taking any locks and run it for as
+   * long as they like -- they never see a half-written set of weights. Snapshots that are no
+   * longer current are reclaimed (and their buffers reused) once no reader has them pinned.
+   *
+   * Pinning is implemented with hazard pointers: each reader announces the Snapshot it is about
+   * to use before using it, and publish() only recycles Snapshots nobody has announced.
+   */
+  class ParameterStore {
+  private:
+    struct Hazard {
+      Hazard() : snapshot(NULL), active(false), next(NULL) {}
+      atomic<const Snapshot*> snapshot;
+      atomic<bool> active;
+      Hazard* next;
+    };
+  public:
+    /**
+     * Keeps a Snapshot alive while it is in scope -- get one from ParameterStore::pin()
+     */
+    class Pin {
+    public:
+      Pin(Pin &&other);
+      ~Pin();
+      inline const Snapshot& operator*() const { return *snapshot; };
+      inline const Snapshot* operator->() const { return snapshot; };
+    private:
+      friend class ParameterStore;
+      Pin(Hazard* h, const Snapshot* s);
+      Pin(const Pin&);
+      Pin& operator=(const Pin&);
+      Hazard* hazard;
+      const Snapshot* snapshot;
+    };
+
+    //! Construct a new store and publish the current weights of \p net as version 1
+    explicit ParameterStore(const Network &net);
+
+    //! Destroy the store -- all Pins must have been released before this!
+    ~ParameterStore();
+
+    //! Pin the current Snapshot. Lock-free, safe to call from any number of threads.
+    Pin pin() const;
+
+    //! Convenience function: pin the current Snapshot and run it for \p input
+    vector<double> run(const vector<double> &input) const;
+
+    /**
+     * Publish the current weights of \p net, replacing the current Snapshot for all
+     * subsequent calls to pin(). Calls to publish() are serialized with a mutex, readers are never blocked.
+     * @return the version number of the new Snapshot
+     */
+    unsigned long publish(const Network &net);
+
+    //! Get the version number of the current Snapshot
+    unsigned long Version() const;
+  private:
+    ParameterStore(const ParameterStore&);
+    ParameterStore& operator=(const ParameterStore&);
+    Hazard* acquireHazard() const;
+    //! Move retired Snapshots that no reader has pinned to the free list
+    void reclaim();
+
+    atomic<Snapshot*> current;
+    //! Singly-linked list of hazard records, only ever grows
+    mutable atomic<Hazard*> hazards;
+    //! Serializes publishers and guards retired/spare
+    mutex publish_mutex;
+    vector<Snapshot*> retired;
+    vector<Snapshot*> spare;
+    atomic<unsigned long> version;
+  };
+}
+#endif
@@ -0,0 +1,128 @@
+#ifndef NEURAL_PIPELINETRAINER_H
+#define NEURAL_PIPELINETRAINER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Network.h"
+#include "SpscQueue.h"
+
+using namespace std;
+
+namespace neural {
+  /**
+   * Trains a deep Network with pipeline parallelism: the layers are split into groups of consecutive
+   * layers ("stages"), each run by its own thread. A mini-batch is cut into micro-batches that flow
+   * from stage to stage through lock-free single-producer/single-consumer queues, so while one stage
+   * runs the forward pass of micro-batch k+1, the next one can already run the backward pass of k.
+   *
+   * Each stage prefers backward work over forward work, and at most MaxInFlight() micro-batches are
+   * between their forward and backward pass at any time, which bounds the memory used for stashed
+   * activations. Like in GPipe, weights are only updated once all micro-batches of a mini-batch have
+   * been back-propagated, so gradients are never computed against stale weights. A stage without
+   * work spins briefly and then sleeps until a neighbour hands it a message, so idle stages don't take
+   * CPU time from busy ones when there are more stages than cores.
+   *
+   * Unlike Network::trainSingle(), which updates the weights after every training case, trainBatch()
+   * applies the mean update of the whole mini-batch.
+   */
+  class PipelineTrainer {
+  public:
+    /**
+     * Start the stage threads
+     * @param net the network to train -- must outlive the PipelineTrainer and may not be used by anybody else while trainBatch() runs
+     * @param stages the number of stages (threads); layers are distributed so each stage gets a similar number of weights.
+     *   There are never more stages than layers.
+     * @param micro_batch the number of training cases in each micro-batch
+     * @param max_in_flight the maximum number of micro-batches between their forward and backward pass --
+     *   0 means twice the number of stages
+     */
+    PipelineTrainer(Network &net, int stages, size_t micro_batch = 8, size_t max_in_flight = 0);
+
+    //! Stop the stage threads
+    ~PipelineTrainer();
+
+    /**
+     * Train the network with one mini-batch
+     * @param inputs the training inputs
+     * @param targets the expected output for each training input
+     * @param learning_rate controls the speed of learning (see Neuron::updateWeights() )
+     * @return the mean error of the mini-batch *before* the update
+     */
+    double trainBatch(const vector<vector<double> > &inputs, const vector<vector<double> > &targets,
+		      double learning_rate = 0.3);
+
+    //! Get the number of stages
+    inline int Stages() const { return stages.size(); };
+
+    //! Get the number of layers run by stage \p s
+    inline int StageLayers(int s) const { return stages[s]->layers.size(); };
+
+    //! Get the maximum number of micro-batches in flight
+    inline size_t MaxInFlight() const { return max_in_flight; };
+  private:
+    PipelineTrainer(const PipelineTrainer&);
+    PipelineTrainer& operator=(const PipelineTrainer&);
+
+    //! A micro-batch travelling between stages: activations going forward, summed weighed deltas going backward
+    struct Message {
+      size_t id;
+      size_t count;
+      vector<double> data;
+    };
+
+    struct Stage {
+      Stage(size_t queue_size) : forward_in(queue_size), backward_in(queue_size), wakeups(0) {}
+      vector<shared_ptr<Layer> > layers;
+      //! Offset of each layer's first weight in gradients
+      vector<size_t> offsets;
+      SpscQueue<Message> forward_in;
+      SpscQueue<Message> backward_in;
+      //! Inputs and outputs of each layer for each micro-batch between its forward and backward pass
+      map<size_t, vector<vector<double> > > stash;
+      thread worker;
+      //! Counts wake() calls -- incremented under wake_m, so a waiting stage never misses one
+      atomic<unsigned long> wakeups;
+      mutex wake_m;
+      condition_variable wake_cv;
+    };
+
+    void work(size_t s);
+    //! Run one mini-batch through stage \p s
+    void runStage(size_t s);
+    void forward(size_t s, Message &msg);
+    void backward(size_t s, Message &msg);
+    //! [Stage \p s] Push \p msg into \p queue of stage \p to, waiting while it is full
+    void send(size_t s, size_t to, SpscQueue<Message> &queue, Message &msg);
+    //! Tell stage \p s that one of its queues changed
+    void wake(size_t s);
+    //! [Stage \p s] Block until wake(s) is called, unless it has been since wakeups was \p seen
+    void sleep(size_t s, unsigned long seen);
+
+    Network &net;
+    size_t micro_batch;
+    size_t max_in_flight;
+    vector<unique_ptr<Stage> > stages;
+    //! Gradients of all weights, in the order of Network::copyParameters() -- each stage owns its own range
+    vector<double> gradients;
+
+    // Current mini-batch, set before the stage threads are woken up
+    const vector<vector<double> >* batch_inputs;
+    const vector<vector<double> >* batch_targets;
+    size_t micro_batches;
+    //! Summed error of the current mini-batch, only written by the last stage
+    double error;
+
+    mutex m;
+    condition_variable start_cv;
+    condition_variable done_cv;
+    unsigned long generation;
+    size_t running;
+    bool stopping;
+  };
+}
+#endif
@@ -0,0 +1,60 @@
+#ifndef NEURAL_SNAPSHOT_H
+#define NEURAL_SNAPSHOT_H
+
+#include <vector>
+#include <functional>
+#include <iostream>
+#include "Network.h"
+
+using namespace std;
+
+namespace neural {
+  /**
+   * An immutable copy of a Network's weights and shape. Unlike Network::run(), Snapshot::run()
+   * keeps all intermediate values on the caller's stack, so any number of threads can run
+   * the same Snapshot at once.
+   */
+  class Snapshot {
+  public:
+    //! Construct an empty Snapshot (0 layers)
+    Snapshot();
+
+    //! Construct a Snapshot of \p net
+    explicit Snapshot(const Network &net);
+
+    /**
+     * Overwrite this Snapshot with the current state of \p net, reusing the existing buffers
+     * where possible. Don't call this while other threads may be using the Snapshot!
+     */
+    void capture(const Network &net);
+
+    //! Run the captured network for the given input
+    vector<double> run(const vector<double> &input) const;
+
+    inline int Inputs() const { return input_count; };
+    inline int Outputs() const { return sizes.empty() ? 0 : sizes.back(); };
+    inline int Layers() const { return sizes.size(); };
+
+    //! Get the captured weights, in the order of Network::copyParameters()
+    inline const vector<double>& Parameters() const { return params; };
+
+    /**
+     * Serialize the captured network into \p s, in the same format as Network::write() --
+     * read it back with Network::read()
+     */
+    bool write(ostream &s) const;
+
+    //! Get the version number assigned by the ParameterStore that published this Snapshot
+    inline unsigned long Version() const { return version; };
+  private:
+    friend class ParameterStore;
+    int input_count;
+    //! Number of neurons in each layer
+    vector<int> sizes;
+    vector<double> params;
+    //! One activation function per neuron, across all layers
+    vector<std::function<double (double)> > activations;
+    unsigned long version;
+  };
+}
+#endif
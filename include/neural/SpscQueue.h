@@ -0,0 +1,62 @@
+#ifndef NEURAL_SPSCQUEUE_H
+#define NEURAL_SPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace neural {
+  /**
+   * A bounded, lock-free queue for exactly one producer thread and one consumer thread.
+   */
+  template <class T>
+  class SpscQueue {
+  public:
+    //! Construct a queue that holds up to \p capacity items
+    explicit SpscQueue(size_t capacity) :
+      slots(capacity + 1),
+      head(0),
+      tail(0)
+    {}
+
+    /**
+     * [Producer] Append \p item, moving from it
+     * @return false (leaving \p item untouched) if the queue is full
+     */
+    bool push(T &item) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      size_t next = t + 1 == slots.size() ? 0 : t + 1;
+      if (next == head.load(std::memory_order_acquire)) {
+	return false;
+      }
+      slots[t] = std::move(item);
+      tail.store(next, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * [Consumer] Remove the oldest item and move it into \p item
+     * @return false if the queue is empty
+     */
+    bool pop(T &item) {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire)) {
+	return false;
+      }
+      item = std::move(slots[h]);
+      head.store(h + 1 == slots.size() ? 0 : h + 1, std::memory_order_release);
+      return true;
+    }
+  private:
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+    std::vector<T> slots;
+    //! Next slot to pop
+    std::atomic<size_t> head;
+    // Keep head and tail on separate cache lines, so producer and consumer don't fight over one
+    char padding[64];
+    //! Next slot to push
+    std::atomic<size_t> tail;
+  };
+}
+#endif
@@ -0,0 +1,98 @@
+#ifndef NEURAL_TRAINER_H
+#define NEURAL_TRAINER_H
+
+#include <random>
+#include <vector>
+#include "Network.h"
+
+using namespace std;
+
+namespace neural {
+  /**
+   * Trains a Network for a number of epochs over a data set, with optional validation and early stopping.
+   *
+   * Each epoch visits the training cases in a new random order. The training error is taken from
+   * the forward pass back propagation needs anyway (see Network::trainStep()), so it is the mean
+   * error *before* each update. Every ValidationInterval() epochs the validation set (or, if
+   * there is none, the epoch's training error) is checked; after Patience() checks without an
+   * improvement of at least MinImprovement(), training stops and the best weights seen are restored.
+   */
+  class Trainer {
+  public:
+    //! Construct a Trainer for \p net -- \p net must outlive the Trainer
+    Trainer(Network &net);
+
+    /**
+     * Train the network
+     * @param inputs the training inputs
+     * @param targets the expected output for each training input
+     * @param validation_inputs optional inputs used to decide when to stop
+     * @param validation_targets the expected output for each validation input
+     * @return the best error seen (validation error if there is a validation set, training error otherwise)
+     */
+    double train(const vector<vector<double> > &inputs, const vector<vector<double> > &targets,
+		 const vector<vector<double> > &validation_inputs = vector<vector<double> >(),
+		 const vector<vector<double> > &validation_targets = vector<vector<double> >());
+
+    /**
+     * Get the mean squared error of the network over a data set, running it ValidationBatch() inputs at a time
+     * (see Network::runBatch())
+     */
+    double validate(const vector<vector<double> > &inputs, const vector<vector<double> > &targets) const;
+
+    //! Learning rate passed to Network::trainStep() -- defaults to 0.3
+    inline void setLearningRate(double rate) { learning_rate = rate; };
+    inline double LearningRate() const { return learning_rate; };
+
+    //! Maximum number of epochs to train -- defaults to 100
+    inline void setMaxEpochs(int epochs) { max_epochs = epochs; };
+    inline int MaxEpochs() const { return max_epochs; };
+
+    //! Check for improvement every \p epochs epochs -- defaults to 1
+    inline void setValidationInterval(int epochs) { validation_interval = epochs < 1 ? 1 : epochs; };
+    inline int ValidationInterval() const { return validation_interval; };
+
+    //! Number of inputs run at once during validation -- defaults to 64
+    inline void setValidationBatch(size_t batch) { validation_batch = batch < 1 ? 1 : batch; };
+    inline size_t ValidationBatch() const { return validation_batch; };
+
+    //! Stop after this many checks without improvement -- defaults to 5, 0 disables early stopping
+    inline void setPatience(int checks) { patience = checks; };
+    inline int Patience() const { return patience; };
+
+    //! Smallest decrease of the error that counts as an improvement -- defaults to 0
+    inline void setMinImprovement(double delta) { min_improvement = delta; };
+    inline double MinImprovement() const { return min_improvement; };
+
+    //! Seed the random number generator used for shuffling
+    inline void setSeed(unsigned int seed) { rng.seed(seed); };
+
+    //! Get the number of epochs the last call to train() ran
+    inline int Epochs() const { return epochs; };
+
+    //! Get the epoch (counting from 1) the restored weights are from
+    inline int BestEpoch() const { return best_epoch; };
+
+    //! True if the last call to train() stopped early
+    inline bool Stopped() const { return stopped; };
+
+    //! Get the mean training error of each epoch of the last call to train()
+    inline const vector<double>& TrainingErrors() const { return training_errors; };
+  private:
+    Network &net;
+    double learning_rate;
+    int max_epochs;
+    int validation_interval;
+    size_t validation_batch;
+    int patience;
+    double min_improvement;
+    mt19937 rng;
+    int epochs;
+    int best_epoch;
+    bool stopped;
+    vector<double> training_errors;
+    //! Visiting order of the training cases, shuffled in place each epoch
+    vector<size_t> order;
+  };
+}
+#endif
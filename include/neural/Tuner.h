@@ -0,0 +1,83 @@
+#ifndef NEURAL_TUNER_H
+#define NEURAL_TUNER_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include "Kernel.h"
+#include "Layer.h"
+
+using namespace std;
+
+namespace neural {
+  /**
+   * Picks the fastest KernelConfig for each (rows, cols, batch) layer shape by benchmarking
+   * a few candidates the first time a shape is seen. Results are saved to a tuning file (merged with
+   * whatever other processes have saved there meanwhile), so later runs on the same machine can skip
+   * the benchmark. Entries are tagged with Machine(), so a tuning file shared by different
+   * machines (e.g. a home directory baked into an image) never hands one machine's winners to another.
+   *
+   * Environment variables:
+   * - <tt>NEURAL_TUNING_FILE</tt>: path of the tuning file (default: <tt>$HOME/.neural_tuning</tt>)
+   * - <tt>NEURAL_KERNEL</tt>: use this configuration (e.g. "blocked:4", see KernelConfig::parse())
+   *   for every shape instead of tuning
+   *
+   * Use Network::tune() rather than calling this directly.
+   */
+  class Tuner {
+  public:
+    //! Get the process-wide Tuner -- loads the tuning file on first use
+    static Tuner& instance();
+
+    /**
+     * Get the best configuration for \p layer running \p batch inputs at once,
+     * benchmarking (and saving the tuning file) if the shape hasn't been tuned before
+     */
+    KernelConfig tune(const Layer &layer, size_t batch);
+
+    /**
+     * Look up a previously tuned configuration
+     * @return false if the shape hasn't been tuned yet
+     */
+    bool lookup(size_t rows, size_t cols, size_t batch, KernelConfig &config);
+
+    //! Get the path of the tuning file
+    inline const string& Path() const { return path; };
+
+    //! Get the identity of this machine used in the tuning file: CPU model and number of hardware threads
+    inline const string& Machine() const { return machine; };
+  private:
+    Tuner();
+    Tuner(const Tuner&);
+    Tuner& operator=(const Tuner&);
+    KernelConfig benchmark(const Layer &layer, size_t batch) const;
+
+    struct Shape {
+      Shape(const string &m, size_t r, size_t c, size_t b) : machine(m), rows(r), cols(c), batch(b) {}
+      bool operator<(const Shape &other) const {
+	if (machine != other.machine) return machine < other.machine;
+	if (rows != other.rows) return rows < other.rows;
+	if (cols != other.cols) return cols < other.cols;
+	return batch < other.batch;
+      }
+      string machine;
+      size_t rows;
+      size_t cols;
+      size_t batch;
+    };
+
+    //! Read the tuning file into \p into, replacing entries for the same shapes
+    void load(map<Shape, KernelConfig> &into) const;
+    //! Merge the tuning file into the cache and write the result back
+    bool save();
+    static string machineIdentity();
+
+    string path;
+    string machine;
+    bool has_override;
+    KernelConfig override_config;
+    map<Shape, KernelConfig> cache;
+    mutex m;
+  };
+}
+#endif
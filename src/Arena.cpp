@@ -0,0 +1,100 @@
+#include "neural/Arena.h"
+#include <cassert>
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define NEURAL_HAVE_MMAP
+#endif
+
+namespace neural {
+  namespace {
+    const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    size_t roundUp(size_t n, size_t to) {
+      return (n + to - 1) / to * to;
+    }
+  }
+
+  Arena::Arena(size_t cap, size_t align_to, bool huge_pages) :
+    base(NULL),
+    capacity(0),
+    used(0),
+    alignment(align_to),
+    huge(false),
+    mapped(false)
+  {
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    if (cap == 0) return;
+#ifdef NEURAL_HAVE_MMAP
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only work if the admin reserved some, so this fails more often than not
+    if (huge_pages && cap >= HUGE_PAGE_SIZE) {
+      size_t size = roundUp(cap, HUGE_PAGE_SIZE);
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED) {
+	capacity = size;
+	huge = true;
+      }
+    }
+#endif
+    if (p == MAP_FAILED) {
+      // Align the mapping size to huge pages as well, so transparent huge pages can cover all of it
+      size_t size = roundUp(cap, huge_pages ? HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE));
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p != MAP_FAILED) {
+	capacity = size;
+#ifdef MADV_HUGEPAGE
+	if (huge_pages) {
+	  huge = madvise(p, size, MADV_HUGEPAGE) == 0;
+	}
+#endif
+      }
+    }
+    if (p != MAP_FAILED) {
+      base = static_cast<char*>(p);
+      mapped = true;
+      return;
+    }
+#endif
+    // No mmap (or it failed) -- fall back to an aligned heap block
+    size_t size = roundUp(cap, alignment);
+    void* heap = NULL;
+#ifdef NEURAL_HAVE_MMAP
+    if (posix_memalign(&heap, alignment < sizeof(void*) ? sizeof(void*) : alignment, size) != 0) {
+      heap = NULL;
+    }
+#else
+    heap = aligned_alloc(alignment, size);
+#endif
+    if (heap) {
+      base = static_cast<char*>(heap);
+      capacity = size;
+    }
+  }
+
+  Arena::~Arena() {
+    if (!base) return;
+#ifdef NEURAL_HAVE_MMAP
+    if (mapped) {
+      munmap(base, capacity);
+      return;
+    }
+#endif
+    free(base);
+  }
+
+  void* Arena::allocate(size_t bytes, size_t align_to) {
+    if (align_to < alignment) {
+      align_to = alignment;
+    }
+    size_t start = roundUp(used, align_to);
+    if (!base || start + bytes > capacity) {
+      return NULL;
+    }
+    used = start + bytes;
+    return base + start;
+  }
+}
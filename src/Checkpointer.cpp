@@ -0,0 +1,144 @@
+#include "neural/Checkpointer.h"
+#include "FileIO.h"
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#define NEURAL_HAVE_DIRENT
+#endif
+
+namespace neural {
+  namespace {
+    //! Split \p filename into its directory ("." if there is none) and base name
+    void splitPath(const string &filename, string &dir, string &base) {
+      size_t slash = filename.find_last_of('/');
+      if (slash == string::npos) {
+	dir = ".";
+	base = filename;
+      } else {
+	dir = slash == 0 ? "/" : filename.substr(0, slash);
+	base = filename.substr(slash + 1);
+      }
+    }
+  }
+
+  Checkpointer::Checkpointer(const string &p, int k) :
+    path(p),
+    keep(k < 1 ? 1 : k),
+    writing(&buffers[0]),
+    pending(&buffers[1]),
+    has_pending(false),
+    busy(false),
+    stopping(false),
+    failed(false),
+    sequence(0)
+  {
+    // Continue after the checkpoints of a previous run, so they are neither overwritten nor left behind
+    vector<unsigned long> existing = existingCheckpoints(path);
+    for (size_t i = 0; i < existing.size(); i++) {
+      ostringstream name;
+      name << path << "." << existing[i];
+      written.push_back(name.str());
+    }
+    if (!existing.empty()) {
+      sequence = existing.back();
+    }
+    worker = thread(&Checkpointer::work, this);
+  }
+
+  Checkpointer::~Checkpointer() {
+    {
+      lock_guard<mutex> lock(m);
+      stopping = true;
+    }
+    cv.notify_all();
+    worker.join();
+  }
+
+  void Checkpointer::save(const Network &net) {
+    {
+      lock_guard<mutex> lock(m);
+      pending->capture(net);
+      has_pending = true;
+    }
+    cv.notify_all();
+  }
+
+  bool Checkpointer::wait() {
+    unique_lock<mutex> lock(m);
+    while (has_pending || busy) {
+      cv.wait(lock);
+    }
+    bool success = !failed;
+    failed = false;
+    return success;
+  }
+
+  string Checkpointer::Latest() {
+    lock_guard<mutex> lock(m);
+    return written.empty() ? string() : written.back();
+  }
+
+  void Checkpointer::work() {
+    unique_lock<mutex> lock(m);
+    while (true) {
+      while (!has_pending && !stopping) {
+	cv.wait(lock);
+      }
+      if (!has_pending) {
+	// stopping, and everything has been written
+	return;
+      }
+      std::swap(writing, pending);
+      has_pending = false;
+      busy = true;
+      ostringstream name;
+      name << path << "." << ++sequence;
+      lock.unlock();
+
+      // Serialize and write without holding the lock, so save() can fill the other buffer meanwhile
+      ostringstream data(ios_base::out | ios_base::binary);
+      bool success = writing->write(data) && writeDurably(name.str(), data.str());
+
+      lock.lock();
+      busy = false;
+      if (success) {
+	written.push_back(name.str());
+	while ((int) written.size() > keep) {
+	  remove(written.front().c_str());
+	  written.pop_front();
+	}
+      } else {
+	failed = true;
+      }
+      cv.notify_all();
+    }
+  }
+
+  vector<unsigned long> Checkpointer::existingCheckpoints(const string &path) {
+    vector<unsigned long> sequences;
+#ifdef NEURAL_HAVE_DIRENT
+    string dir, base;
+    splitPath(path, dir, base);
+    base += ".";
+    DIR* d = opendir(dir.c_str());
+    if (!d) return sequences;
+    while (struct dirent* entry = readdir(d)) {
+      string name = entry->d_name;
+      if (name.size() <= base.size() || name.compare(0, base.size(), base) != 0) continue;
+      string number = name.substr(base.size());
+      // Skips temporary files (path.N.tmp) and anything else that isn't just a number
+      if (number.find_first_not_of("0123456789") != string::npos) continue;
+      unsigned long n = strtoul(number.c_str(), NULL, 10);
+      if (n > 0) sequences.push_back(n);
+    }
+    closedir(d);
+    std::sort(sequences.begin(), sequences.end());
+#endif
+    return sequences;
+  }
+}
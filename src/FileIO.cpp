@@ -0,0 +1,94 @@
+#include "FileIO.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define NEURAL_HAVE_FSYNC
+#endif
+
+namespace neural {
+#ifdef NEURAL_HAVE_FSYNC
+  namespace {
+    //! Write all of \p data to \p fd, continuing after short writes
+    bool writeAll(int fd, const string &data) {
+      const char* p = data.data();
+      size_t left = data.size();
+      while (left > 0) {
+	ssize_t n = ::write(fd, p, left);
+	if (n < 0) return false;
+	p += n;
+	left -= n;
+      }
+      return true;
+    }
+  }
+#endif
+
+  bool writeDurably(const string &filename, const string &data) {
+#ifdef NEURAL_HAVE_FSYNC
+    // A name of our own, so several processes writing the same file never mix their data
+    string pattern = filename + ".XXXXXX";
+    vector<char> tmp(pattern.begin(), pattern.end());
+    tmp.push_back('\0');
+    int fd = mkstemp(tmp.data());
+    if (fd < 0) return false;
+    bool success = fchmod(fd, 0644) == 0 && writeAll(fd, data) && fsync(fd) == 0;
+    success &= close(fd) == 0;
+    if (!success || rename(tmp.data(), filename.c_str()) != 0) {
+      remove(tmp.data());
+      return false;
+    }
+    // Make the rename itself durable
+    string dir = ".";
+    size_t slash = filename.find_last_of('/');
+    if (slash != string::npos) {
+      dir = slash == 0 ? "/" : filename.substr(0, slash);
+    }
+    int dir_fd = open(dir.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+    return true;
+#else
+    ostringstream name;
+    name << filename << "." << chrono::steady_clock::now().time_since_epoch().count() << ".tmp";
+    string tmp = name.str();
+    {
+      ofstream file(tmp.c_str(), ios_base::out | ios_base::binary);
+      if (!file.is_open()) return false;
+      file.write(data.data(), data.size());
+      if (!file.good()) return false;
+    }
+    // rename() doesn't replace existing files everywhere
+    remove(filename.c_str());
+    return rename(tmp.c_str(), filename.c_str()) == 0;
+#endif
+  }
+
+  bool appendDurably(const string &filename, const string &data) {
+#ifdef NEURAL_HAVE_FSYNC
+    int fd = open(filename.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) return false;
+    off_t size = lseek(fd, 0, SEEK_END);
+    bool success = size >= 0 && writeAll(fd, data) && fsync(fd) == 0;
+    if (!success && size >= 0) {
+      // Cut off whatever part of data made it, so the file stays readable up to here
+      if (ftruncate(fd, size) == 0) fsync(fd);
+    }
+    return close(fd) == 0 && success;
+#else
+    ofstream file(filename.c_str(), ios_base::out | ios_base::binary | ios_base::app);
+    if (!file.is_open()) return false;
+    file.write(data.data(), data.size());
+    file.flush();
+    return file.good();
+#endif
+  }
+}
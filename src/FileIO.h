@@ -0,0 +1,24 @@
+#ifndef NEURAL_FILEIO_H
+#define NEURAL_FILEIO_H
+
+#include <string>
+
+using namespace std;
+
+// Internal helpers shared by Checkpointer, Journal and Tuner -- not installed with the public headers
+
+namespace neural {
+  /**
+   * Replace \p filename with \p data atomically and durably: write a uniquely named temporary file,
+   * fsync() it and rename() it over \p filename, then fsync() the directory
+   * @return false if anything failed -- \p filename is untouched in that case
+   */
+  bool writeDurably(const string &filename, const string &data);
+
+  /**
+   * Append \p data to the existing file \p filename and fsync() it
+   * @return false if anything failed -- the file is cut back to its previous size in that case, if possible
+   */
+  bool appendDurably(const string &filename, const string &data);
+}
+#endif
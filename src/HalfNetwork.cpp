@@ -0,0 +1,173 @@
+#include "neural/HalfNetwork.h"
+#include <cassert>
+#include <fstream>
+
+namespace neural {
+  HalfNetwork::HalfNetwork(Format f, int inputs) :
+    format(f),
+    input_count(inputs)
+  {}
+
+  HalfNetwork::HalfNetwork(const Network &net, Format f) :
+    format(f),
+    input_count(net.Inputs())
+  {
+    vector<double> params(net.parameterCount());
+    net.copyParameters(params.data());
+    weights.reserve(params.size());
+    for (size_t i = 0; i < params.size(); i++) {
+      weights.push_back(format == BFLOAT16 ? half::toBFloat16(params[i]) : half::toFloat16(params[i]));
+    }
+    for (shared_ptr<Layer> current = net.firstLayer(); current; current = current->nextLayer()) {
+      sizes.push_back(current->size());
+      for (int i = 0; i < current->size(); i++) {
+	activations.push_back(current->neuron(i).Activation());
+      }
+    }
+  }
+
+  HalfNetwork HalfNetwork::read(string &filename) {
+    ifstream file(filename.c_str(), ios_base::in | ios_base::binary);
+    if (!file.is_open()) {
+      return HalfNetwork(BFLOAT16, 0);
+    }
+    HalfNetwork result = read(file);
+    file.close();
+    return result;
+  }
+
+  HalfNetwork HalfNetwork::read(istream &s) {
+    HalfNetwork fail(BFLOAT16, 0);
+    if (!s.good()) return fail;
+    string keyword;
+    s >> keyword;
+    if (keyword != "HALFNETWORK") return fail;
+
+    s >> keyword;
+    if (keyword != "format") return fail;
+    string format_name;
+    s >> format_name;
+    Format f;
+    if (format_name == "bf16") {
+      f = BFLOAT16;
+    } else if (format_name == "fp16") {
+      f = FLOAT16;
+    } else {
+      return fail;
+    }
+
+    s >> keyword;
+    if (keyword != "input_size") return fail;
+    int input_size;
+    s >> input_size;
+
+    s >> keyword;
+    if (keyword != "layers") return fail;
+    int layers;
+    s >> layers;
+    if (!s.good() || layers <= 0) return fail;
+
+    HalfNetwork result(f, input_size);
+    int inputs = input_size;
+    for (int l = 0; l < layers; l++) {
+      s >> keyword;
+      if (keyword != "LAYER") return fail;
+      s >> keyword;
+      if (keyword != "inputs") return fail;
+      int layer_inputs;
+      s >> layer_inputs;
+      if (layer_inputs != inputs) return fail;
+      s >> keyword;
+      if (keyword != "neurons") return fail;
+      int neuron_count;
+      s >> neuron_count;
+      if (!s.good() || neuron_count <= 0) return fail;
+
+      for (int i = 0; i < neuron_count; i++) {
+	s >> keyword;
+	if (keyword != "NEURON") return fail;
+	s >> keyword;
+	if (keyword != "size") return fail;
+	int data_size;
+	s >> data_size;
+	if (data_size != inputs + 1) return fail;
+	s >> keyword;
+	if (keyword != "data") return fail;
+	// consume space after "data"
+	if (s.get() != ' ') return fail;
+	size_t start = result.weights.size();
+	result.weights.resize(start + data_size);
+	s.read(reinterpret_cast<char*>(&result.weights[start]), data_size * sizeof(uint16_t));
+	// consume ending newline
+	if (s.get() != '\n' || !s.good()) return fail;
+	result.activations.push_back(activation::tanh_func);
+      }
+      result.sizes.push_back(neuron_count);
+      inputs = neuron_count;
+    }
+    return result;
+  }
+
+  template <float (*widen)(uint16_t)>
+  void HalfNetwork::runLayer(const uint16_t* w, const vector<double> &in, vector<double> &out,
+			     const std::function<double (double)>* activations) {
+    for (size_t i = 0; i < out.size(); i++) {
+      double sum = widen(w[in.size()]); // bias
+      for (size_t j = 0; j < in.size(); j++) {
+	sum += in[j] * widen(w[j]);
+      }
+      out[i] = activations[i](sum);
+      w += in.size() + 1;
+    }
+  }
+
+  vector<double> HalfNetwork::run(const vector<double> &input) const {
+    assert((int) input.size() == input_count);
+    vector<double> current(input);
+    vector<double> next;
+    const uint16_t* w = weights.data();
+    const std::function<double (double)>* a = activations.data();
+    for (size_t l = 0; l < sizes.size(); l++) {
+      next.resize(sizes[l]);
+      if (format == BFLOAT16) {
+	runLayer<half::fromBFloat16>(w, current, next, a);
+      } else {
+	runLayer<half::fromFloat16>(w, current, next, a);
+      }
+      w += sizes[l] * (current.size() + 1);
+      a += sizes[l];
+      current.swap(next);
+    }
+    return current;
+  }
+
+  bool HalfNetwork::write(string &filename) const {
+    ofstream file(filename.c_str(), ios_base::out | ios_base::binary);
+    if (!file.is_open()) {
+      return false;
+    }
+    bool success = write(file);
+    file.close();
+    return success;
+  }
+
+  bool HalfNetwork::write(ostream &s) const {
+    if (!s.good()) return false;
+    s << "HALFNETWORK" << "\n"
+      << "format " << (format == BFLOAT16 ? "bf16" : "fp16") << "\n"
+      << "input_size " << input_count << "\n"
+      << "layers " << sizes.size() << "\n";
+    const uint16_t* w = weights.data();
+    int inputs = input_count;
+    bool success = s.good();
+    for (size_t l = 0; success && l < sizes.size(); l++) {
+      success &= Layer::writeHeader(s, inputs, sizes[l]);
+      for (int i = 0; success && i < sizes[l]; i++) {
+	success &= Neuron::write(s, w, inputs + 1, sizeof(uint16_t));
+	w += inputs + 1;
+      }
+      inputs = sizes[l];
+    }
+    return success;
+  }
+}
@@ -0,0 +1,123 @@
+#include "neural/InferenceCache.h"
+#include <cmath>
+#include <cstring>
+
+namespace neural {
+  InferenceCache::InferenceCache(size_t capacity, int shard_count, double q) :
+    quantum(q),
+    generation(0),
+    hits(0),
+    misses(0),
+    evictions(0)
+  {
+    if (shard_count < 1) shard_count = 1;
+    shard_capacity = (capacity + shard_count - 1) / shard_count;
+    if (shard_capacity < 1) shard_capacity = 1;
+    for (int i = 0; i < shard_count; i++) {
+      shards.push_back(unique_ptr<Shard>(new Shard()));
+    }
+  }
+
+  bool InferenceCache::lookup(const vector<double> &input, vector<double> &output) {
+    vector<uint64_t> key;
+    makeKey(input, key);
+    uint64_t h = hash(key);
+    Shard &shard = shardFor(h);
+    {
+      lock_guard<mutex> lock(shard.m);
+      unordered_map<uint64_t, list<Entry>::iterator>::iterator found = shard.index.find(h);
+      if (found != shard.index.end()) {
+	list<Entry>::iterator entry = found->second;
+	if (entry->generation != generation.load()) {
+	  // Computed with old weights -- make room right away
+	  shard.index.erase(found);
+	  shard.lru.erase(entry);
+	} else if (entry->key == key) {
+	  shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+	  output = entry->output;
+	  hits++;
+	  return true;
+	}
+      }
+    }
+    misses++;
+    return false;
+  }
+
+  void InferenceCache::insert(const vector<double> &input, const vector<double> &output, unsigned long computed) {
+    if (computed != generation.load()) {
+      return;
+    }
+    vector<uint64_t> key;
+    makeKey(input, key);
+    uint64_t h = hash(key);
+    Shard &shard = shardFor(h);
+    lock_guard<mutex> lock(shard.m);
+    unordered_map<uint64_t, list<Entry>::iterator>::iterator found = shard.index.find(h);
+    if (found != shard.index.end()) {
+      // Same input (or, very rarely, a different input with the same hash): replace it
+      list<Entry>::iterator entry = found->second;
+      entry->generation = computed;
+      entry->key.swap(key);
+      entry->output = output;
+      shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+      return;
+    }
+    shard.lru.push_front(Entry());
+    Entry &entry = shard.lru.front();
+    entry.hash = h;
+    entry.generation = computed;
+    entry.key.swap(key);
+    entry.output = output;
+    shard.index[h] = shard.lru.begin();
+    if (shard.lru.size() > shard_capacity) {
+      shard.index.erase(shard.lru.back().hash);
+      shard.lru.pop_back();
+      evictions++;
+    }
+  }
+
+  size_t InferenceCache::Size() const {
+    size_t size = 0;
+    for (size_t i = 0; i < shards.size(); i++) {
+      lock_guard<mutex> lock(shards[i]->m);
+      size += shards[i]->lru.size();
+    }
+    return size;
+  }
+
+  void InferenceCache::makeKey(const vector<double> &input, vector<uint64_t> &key) const {
+    if (quantum <= 0) {
+      key.resize(input.size());
+      memcpy(key.data(), input.data(), input.size() * sizeof(uint64_t));
+      return;
+    }
+    // One bit per input after the values, telling rounded values from exact ones
+    key.assign(input.size() + (input.size() + 63) / 64, 0);
+    for (size_t i = 0; i < input.size(); i++) {
+      // Rounding in double never overflows, unlike converting to an integer; + 0.0 turns -0 into 0
+      double q = std::nearbyint(input[i] / quantum) + 0.0;
+      if (!std::isfinite(q)) {
+	// Infinite, NaN or too large to divide by quantum
+	q = input[i];
+	key[input.size() + i / 64] |= uint64_t(1) << (i % 64);
+      }
+      memcpy(&key[i], &q, sizeof(uint64_t));
+    }
+  }
+
+  uint64_t InferenceCache::hash(const vector<uint64_t> &key) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ key.size();
+    for (size_t i = 0; i < key.size(); i++) {
+      h = (h ^ key[i]) * 0xBF58476D1CE4E5B9ULL;
+      h ^= h >> 31;
+    }
+    // splitmix64 finalizer, so both halves of the hash are well mixed
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+  }
+}
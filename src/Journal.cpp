@@ -0,0 +1,212 @@
+#include "neural/Journal.h"
+#include "FileIO.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+namespace neural {
+  namespace {
+    //! FNV-1a, continuing from \p hash
+    uint64_t checksum(const void* data, size_t size, uint64_t hash) {
+      const unsigned char* p = static_cast<const unsigned char*>(data);
+      for (size_t i = 0; i < size; i++) {
+	hash = (hash ^ p[i]) * 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    const uint64_t CHECKSUM_START = 14695981039346656037ULL;
+
+    struct Entry {
+      int layer;
+      int neuron;
+      vector<double> weights;
+    };
+
+    uint64_t checksum(const Entry &e, uint64_t hash) {
+      int32_t header[3] = { e.layer, e.neuron, (int32_t) e.weights.size() };
+      hash = checksum(header, sizeof(header), hash);
+      return checksum(e.weights.data(), e.weights.size() * sizeof(double), hash);
+    }
+  }
+
+  Journal::Journal(const string &p, double t) :
+    path(p),
+    threshold(t),
+    base_interval(1000),
+    generation(0),
+    records(0),
+    torn(false)
+  {
+    // Continue the generation count of an existing journal, so its base snapshot isn't overwritten
+    ifstream file(path.c_str(), ios_base::in | ios_base::binary);
+    unsigned long existing;
+    if (file.is_open() && readHeader(file, existing)) {
+      generation = existing;
+    }
+  }
+
+  int Journal::record(Network &net) {
+    if (reference.empty() || reference.size() != net.parameterCount() || records >= base_interval || torn) {
+      if (!compact(net)) return -1;
+      int neurons = 0;
+      for (shared_ptr<Layer> layer = net.firstLayer(); layer; layer = layer->nextLayer()) {
+	neurons += layer->size();
+      }
+      return neurons;
+    }
+
+    vector<Entry> entries;
+    vector<size_t> offsets;
+    size_t offset = 0;
+    int l = 0;
+    for (shared_ptr<Layer> layer = net.firstLayer(); layer; layer = layer->nextLayer(), l++) {
+      for (int i = 0; i < layer->size(); i++) {
+	const arena_vector<double> &w = layer->neuron(i).Weights();
+	if (layer->isDirty(i)) {
+	  double change = 0.0;
+	  for (size_t j = 0; j < w.size(); j++) {
+	    change = max(change, fabs(w[j] - reference[offset + j]));
+	  }
+	  if (change > threshold) {
+	    Entry e;
+	    e.layer = l;
+	    e.neuron = i;
+	    e.weights.assign(w.begin(), w.end());
+	    entries.push_back(e);
+	    offsets.push_back(offset);
+	  } else if (change == 0.0) {
+	    layer->clearDirty(i);
+	  }
+	  // Neurons with small changes stay dirty, so the changes are written once they add up
+	}
+	offset += w.size();
+      }
+    }
+    if (entries.empty()) {
+      return 0;
+    }
+
+    ostringstream data(ios_base::out | ios_base::binary);
+    data << "RECORD " << records + 1 << " " << entries.size() << "\n";
+    uint64_t hash = CHECKSUM_START;
+    for (size_t e = 0; e < entries.size(); e++) {
+      data << entries[e].layer << " " << entries[e].neuron << " " << entries[e].weights.size() << " ";
+      data.write(reinterpret_cast<const char*>(entries[e].weights.data()), entries[e].weights.size() * sizeof(double));
+      data << "\n";
+      hash = checksum(entries[e], hash);
+    }
+    data << "END " << hash << "\n";
+    if (!appendDurably(path, data.str())) {
+      // load() stops at the first bad record, so never append after one that may be torn
+      torn = true;
+      return -1;
+    }
+
+    records++;
+    l = 0;
+    size_t e = 0;
+    for (shared_ptr<Layer> layer = net.firstLayer(); layer && e < entries.size(); layer = layer->nextLayer(), l++) {
+      for (; e < entries.size() && entries[e].layer == l; e++) {
+	std::copy(entries[e].weights.begin(), entries[e].weights.end(), reference.begin() + offsets[e]);
+	layer->clearDirty(entries[e].neuron);
+      }
+    }
+    return entries.size();
+  }
+
+  bool Journal::compact(Network &net) {
+    ostringstream base(ios_base::out | ios_base::binary);
+    if (!net.write(base) || !writeDurably(baseName(path, generation + 1), base.str())) {
+      return false;
+    }
+    // Switching to the new base is atomic: until the new journal replaces the old one, load() uses the old base
+    ostringstream header;
+    header << "JOURNAL\n" << "base " << generation + 1 << "\n";
+    if (!writeDurably(path, header.str())) {
+      remove(baseName(path, generation + 1).c_str());
+      return false;
+    }
+    if (generation > 0) {
+      remove(baseName(path, generation).c_str());
+    }
+    generation++;
+    records = 0;
+    torn = false;
+    reference.resize(net.parameterCount());
+    net.copyParameters(reference.data());
+    for (shared_ptr<Layer> layer = net.firstLayer(); layer; layer = layer->nextLayer()) {
+      for (int i = 0; i < layer->size(); i++) {
+	layer->clearDirty(i);
+      }
+    }
+    return true;
+  }
+
+  Network Journal::load(const string &path) {
+    ifstream file(path.c_str(), ios_base::in | ios_base::binary);
+    unsigned long base_generation;
+    if (!file.is_open() || !readHeader(file, base_generation)) {
+      return Network(0, 0);
+    }
+    string base_name = baseName(path, base_generation);
+    Network net = Network::read(base_name);
+    if (net.Outputs() == 0) {
+      return net;
+    }
+    vector<shared_ptr<Layer> > layers;
+    for (shared_ptr<Layer> layer = net.firstLayer(); layer; layer = layer->nextLayer()) {
+      layers.push_back(layer);
+    }
+
+    // Replay complete records, stop at the first torn or corrupt one
+    string keyword;
+    while (file >> keyword && keyword == "RECORD") {
+      unsigned long number;
+      size_t count;
+      file >> number >> count;
+      vector<Entry> entries(count);
+      uint64_t hash = CHECKSUM_START;
+      bool valid = file.good();
+      for (size_t e = 0; valid && e < count; e++) {
+	size_t size;
+	file >> entries[e].layer >> entries[e].neuron >> size;
+	valid = file.good() && file.get() == ' ' &&
+	  entries[e].layer >= 0 && entries[e].layer < (int) layers.size() &&
+	  entries[e].neuron >= 0 && entries[e].neuron < layers[entries[e].layer]->size() &&
+	  size == layers[entries[e].layer]->neuron(entries[e].neuron).Weights().size();
+	if (!valid) break;
+	entries[e].weights.resize(size);
+	file.read(reinterpret_cast<char*>(entries[e].weights.data()), size * sizeof(double));
+	valid = file.get() == '\n' && file.good();
+	hash = checksum(entries[e], hash);
+      }
+      uint64_t expected;
+      if (!valid || !(file >> keyword >> expected) || keyword != "END" || expected != hash) {
+	break;
+      }
+      for (size_t e = 0; e < entries.size(); e++) {
+	layers[entries[e].layer]->setWeights(entries[e].neuron, entries[e].weights.data());
+      }
+    }
+    return net;
+  }
+
+  string Journal::baseName(const string &path, unsigned long generation) {
+    ostringstream name;
+    name << path << ".base." << generation;
+    return name.str();
+  }
+
+  bool Journal::readHeader(istream &s, unsigned long &generation) {
+    string keyword;
+    s >> keyword;
+    if (keyword != "JOURNAL") return false;
+    s >> keyword;
+    if (keyword != "base") return false;
+    s >> generation;
+    return !s.fail() && s.get() == '\n';
+  }
+}
@@ -0,0 +1,270 @@
+#include "neural/Kernel.h"
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace neural {
+  namespace {
+    const char* const VARIANT_NAMES[] = { "scalar", "unrolled", "blocked" };
+
+    void scalar(const double* const* w, size_t r0, size_t r1, size_t rows, size_t cols,
+		const double* in, size_t b0, size_t b1, double* out) {
+      for (size_t b = b0; b < b1; b++) {
+	const double* x = in + b * cols;
+	for (size_t i = r0; i < r1; i++) {
+	  const double* wi = w[i];
+	  double sum = wi[cols]; // bias
+	  for (size_t j = 0; j < cols; j++) {
+	    sum += x[j] * wi[j];
+	  }
+	  out[b * rows + i] = sum;
+	}
+      }
+    }
+
+    void unrolled(const double* const* w, size_t r0, size_t r1, size_t rows, size_t cols,
+		  const double* in, size_t b0, size_t b1, double* out) {
+      for (size_t b = b0; b < b1; b++) {
+	const double* x = in + b * cols;
+	for (size_t i = r0; i < r1; i++) {
+	  const double* wi = w[i];
+	  double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+	  size_t j = 0;
+	  for (; j + 4 <= cols; j += 4) {
+	    s0 += x[j] * wi[j];
+	    s1 += x[j + 1] * wi[j + 1];
+	    s2 += x[j + 2] * wi[j + 2];
+	    s3 += x[j + 3] * wi[j + 3];
+	  }
+	  for (; j < cols; j++) {
+	    s0 += x[j] * wi[j];
+	  }
+	  out[b * rows + i] = wi[cols] + ((s0 + s1) + (s2 + s3));
+	}
+      }
+    }
+
+    void blocked(const double* const* w, size_t r0, size_t r1, size_t rows, size_t cols,
+		 const double* in, size_t b0, size_t b1, double* out) {
+      size_t i = r0;
+      for (; i + 4 <= r1; i += 4) {
+	const double* w0 = w[i];
+	const double* w1 = w[i + 1];
+	const double* w2 = w[i + 2];
+	const double* w3 = w[i + 3];
+	// Keep these four rows hot while going through the whole batch
+	for (size_t b = b0; b < b1; b++) {
+	  const double* x = in + b * cols;
+	  double s0 = w0[cols], s1 = w1[cols], s2 = w2[cols], s3 = w3[cols];
+	  for (size_t j = 0; j < cols; j++) {
+	    double xj = x[j];
+	    s0 += xj * w0[j];
+	    s1 += xj * w1[j];
+	    s2 += xj * w2[j];
+	    s3 += xj * w3[j];
+	  }
+	  double* y = out + b * rows + i;
+	  y[0] = s0;
+	  y[1] = s1;
+	  y[2] = s2;
+	  y[3] = s3;
+	}
+      }
+      scalar(w, i, r1, rows, cols, in, b0, b1, out);
+    }
+
+    void run(KernelConfig::Variant variant, const double* const* w, size_t r0, size_t r1, size_t rows, size_t cols,
+	     const double* in, size_t b0, size_t b1, double* out) {
+      switch (variant) {
+      case KernelConfig::UNROLLED:
+	unrolled(w, r0, r1, rows, cols, in, b0, b1, out);
+	break;
+      case KernelConfig::BLOCKED:
+	blocked(w, r0, r1, rows, cols, in, b0, b1, out);
+	break;
+      default:
+	scalar(w, r0, r1, rows, cols, in, b0, b1, out);
+      }
+    }
+
+    //! Counts the chunks of one denseKernel() call that haven't finished yet
+    struct Completion {
+      Completion(size_t n) : remaining(n) {}
+      size_t remaining;
+      std::mutex m;
+      std::condition_variable cv;
+    };
+
+    //! One chunk of a denseKernel() call
+    struct Task {
+      KernelConfig::Variant variant;
+      const double* const* w;
+      size_t r0, r1, rows, cols;
+      const double* in;
+      size_t b0, b1;
+      double* out;
+      Completion* done;
+
+      void operator()() const {
+	run(variant, w, r0, r1, rows, cols, in, b0, b1, out);
+	std::lock_guard<std::mutex> lock(done->m);
+	if (--done->remaining == 0) {
+	  done->cv.notify_all();
+	}
+      }
+    };
+
+    /**
+     * Threads shared by all denseKernel() calls, started once -- starting threads on every call
+     * would cost more than the work itself for all but the largest layers.
+     */
+    class WorkerPool {
+    public:
+      static WorkerPool& instance() {
+	static WorkerPool pool;
+	return pool;
+      }
+
+      void push(const Task &task) {
+	{
+	  std::lock_guard<std::mutex> lock(m);
+	  tasks.push_back(task);
+	}
+	cv.notify_one();
+      }
+
+      /**
+       * Run queued tasks on the calling thread until \p done has completed. Helping out instead
+       * of just waiting keeps concurrent callers making progress when all workers are busy.
+       */
+      void finish(Completion &done) {
+	while (true) {
+	  Task task;
+	  if (pop(task)) {
+	    task();
+	    continue;
+	  }
+	  std::unique_lock<std::mutex> lock(done.m);
+	  // Everything left is already running on a worker
+	  while (done.remaining > 0) {
+	    done.cv.wait(lock);
+	  }
+	  return;
+	}
+      }
+    private:
+      WorkerPool() :
+	stopping(false)
+      {
+	// The calling thread always takes a chunk itself
+	int count = (int) std::thread::hardware_concurrency() - 1;
+	for (int i = 0; i < count; i++) {
+	  workers.push_back(std::thread(&WorkerPool::work, this));
+	}
+      }
+
+      ~WorkerPool() {
+	{
+	  std::lock_guard<std::mutex> lock(m);
+	  stopping = true;
+	}
+	cv.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+	  workers[i].join();
+	}
+      }
+
+      bool pop(Task &task) {
+	std::lock_guard<std::mutex> lock(m);
+	if (tasks.empty()) return false;
+	task = tasks.front();
+	tasks.pop_front();
+	return true;
+      }
+
+      void work() {
+	std::unique_lock<std::mutex> lock(m);
+	while (true) {
+	  while (tasks.empty() && !stopping) {
+	    cv.wait(lock);
+	  }
+	  if (tasks.empty()) {
+	    return;
+	  }
+	  Task task = tasks.front();
+	  tasks.pop_front();
+	  lock.unlock();
+	  task();
+	  lock.lock();
+	}
+      }
+
+      std::vector<std::thread> workers;
+      std::deque<Task> tasks;
+      bool stopping;
+      std::mutex m;
+      std::condition_variable cv;
+    };
+  }
+
+  std::string KernelConfig::toString() const {
+    return std::string(VARIANT_NAMES[variant]) + ":" + std::to_string(threads);
+  }
+
+  bool KernelConfig::parse(const std::string &s, KernelConfig &config) {
+    size_t colon = s.find(':');
+    std::string name = s.substr(0, colon);
+    int t = 1;
+    if (colon != std::string::npos) {
+      t = atoi(s.c_str() + colon + 1);
+      if (t < 1) return false;
+    }
+    for (int v = SCALAR; v <= BLOCKED; v++) {
+      if (name == VARIANT_NAMES[v]) {
+	config = KernelConfig(static_cast<Variant>(v), t);
+	return true;
+      }
+    }
+    return false;
+  }
+
+  void denseKernel(const double* const* w, size_t rows, size_t cols,
+		   const double* in, size_t batch, double* out, const KernelConfig &config) {
+    size_t threads = config.threads < 1 ? 1 : config.threads;
+    // Split the batch if it is large enough, the Neurons otherwise
+    bool split_batch = batch >= threads;
+    size_t work = split_batch ? batch : rows;
+    if (threads > work) threads = work;
+    if (threads <= 1) {
+      run(config.variant, w, 0, rows, rows, cols, in, 0, batch, out);
+      return;
+    }
+    size_t chunk = (work + threads - 1) / threads;
+    size_t chunks = (work + chunk - 1) / chunk;
+    WorkerPool &pool = WorkerPool::instance();
+    Completion done(chunks - 1);
+    for (size_t t = 1; t < chunks; t++) {
+      size_t first = t * chunk;
+      size_t last = first + chunk < work ? first + chunk : work;
+      Task task = { config.variant, w, 0, rows, rows, cols, in, 0, batch, out, &done };
+      if (split_batch) {
+	task.b0 = first;
+	task.b1 = last;
+      } else {
+	task.r0 = first;
+	task.r1 = last;
+      }
+      pool.push(task);
+    }
+    // The calling thread takes the first chunk
+    if (split_batch) {
+      run(config.variant, w, 0, rows, rows, cols, in, 0, chunk, out);
+    } else {
+      run(config.variant, w, 0, chunk, rows, cols, in, 0, batch, out);
+    }
+    pool.finish(done);
+  }
+}
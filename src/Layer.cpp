@@ -1,5 +1,6 @@
 #include "neural/Layer.h"
 #include <cassert>
+#include <algorithm>
 
 namespace neural {
   Layer::Layer(int neuron_count, shared_ptr<Layer> previous) :
@@ -39,14 +40,20 @@ namespace neural {
     prev(previous),
     next(NULL),
     input_count(previous->size()),
-    neurons(neuron_vector)
-  {}
+    neurons(neuron_vector.begin(), neuron_vector.end()),
+    dirty(neuron_vector.size(), true)
+  {
+    updateRows();
+  }
   Layer::Layer(vector<Neuron> neuron_vector, int inputs) :
     prev(NULL),
     next(NULL),
     input_count(inputs),
-    neurons(neuron_vector)
-  {}
+    neurons(neuron_vector.begin(), neuron_vector.end()),
+    dirty(neuron_vector.size(), true)
+  {
+    updateRows();
+  }
 
   /**
    * Read a serialized Layer from a file
@@ -131,16 +138,89 @@ namespace neural {
   }
 
   void Layer::updateOutputs(vector<double> inputs) {
-    output.clear();
-    for (vector<Neuron>::iterator it = neurons.begin(); it != neurons.end(); it++) {
-      it->updateOutput(inputs);
-      output.push_back(it->Output());
+    assert((int) inputs.size() == input_count);
+    // output has room for all neurons (see relocate()), so this never reallocates an Arena-backed buffer
+    output.resize(neurons.size());
+    weightedSums(inputs.data(), 1, output.data(), kernelFor(1));
+    for (size_t i = 0; i < neurons.size(); i++) {
+      neurons[i].activate(output[i]);
+      output[i] = neurons[i].Output();
     }
     if (next) {
-      next->updateOutputs(this->output);
+      next->updateOutputs(Output());
+    }
+  }
+
+  void Layer::forwardBatch(const double* in, size_t batch, double* out) const {
+    weightedSums(in, batch, out, kernelFor(batch));
+    for (size_t b = 0; b < batch; b++) {
+      double* y = out + b * neurons.size();
+      for (size_t i = 0; i < neurons.size(); i++) {
+	y[i] = neurons[i].Activation()(y[i]);
+      }
+    }
+  }
+
+  void Layer::backwardBatch(const double* in, const double* out, const double* summed_weighed_deltas, size_t batch,
+			    double* prev_deltas, double* gradients) const {
+    size_t n = neurons.size();
+    size_t stride = input_count + 1;
+    if (prev_deltas) {
+      std::fill(prev_deltas, prev_deltas + batch * input_count, 0.0);
+    }
+    for (size_t b = 0; b < batch; b++) {
+      const double* x = in + b * input_count;
+      for (size_t i = 0; i < n; i++) {
+	double delta = neurons[i].Derivative()(out[b * n + i]) * summed_weighed_deltas[b * n + i];
+	const double* w = neurons[i].Weights().data();
+	double* g = gradients + i * stride;
+	for (int j = 0; j < input_count; j++) {
+	  g[j] += delta * x[j];
+	}
+	g[input_count] += delta; // bias
+	if (prev_deltas) {
+	  double* d = prev_deltas + b * input_count;
+	  for (int j = 0; j < input_count; j++) {
+	    d[j] += delta * w[j];
+	  }
+	}
+      }
     }
   }
 
+  void Layer::applyGradients(const double* gradients, double scale) {
+    for (arena_vector<Neuron>::iterator it = neurons.begin(); it != neurons.end(); it++) {
+      it->applyGradients(gradients, scale);
+      gradients += it->Weights().size();
+    }
+    std::fill(dirty.begin(), dirty.end(), true);
+  }
+
+  void Layer::weightedSums(const double* in, size_t batch, double* out, const KernelConfig &config) const {
+    assert(rows.size() == neurons.size());
+    denseKernel(rows.data(), rows.size(), input_count, in, batch, out, config);
+  }
+
+  void Layer::setKernel(size_t batch, const KernelConfig &config) {
+    vector<pair<size_t, KernelConfig> >::iterator it = kernels.begin();
+    while (it != kernels.end() && it->first < batch) {
+      it++;
+    }
+    if (it != kernels.end() && it->first == batch) {
+      it->second = config;
+    } else {
+      kernels.insert(it, make_pair(batch, config));
+    }
+  }
+
+  KernelConfig Layer::kernelFor(size_t batch) const {
+    KernelConfig config;
+    for (size_t i = 0; i < kernels.size() && kernels[i].first <= batch; i++) {
+      config = kernels[i].second;
+    }
+    return config;
+  }
+
   void Layer::updateDeltas(vector<double> summed_weighed_deltas) {
     assert(summed_weighed_deltas.size() == this->size());
     vector<double> newDeltas(input_count);
@@ -156,38 +236,109 @@ namespace neural {
   }
 
   void Layer::updateWeights(vector<double> inputs, double learning_rate) {
-    for (vector<Neuron>::iterator it = neurons.begin(); it != neurons.end(); it++) {
+    for (arena_vector<Neuron>::iterator it = neurons.begin(); it != neurons.end(); it++) {
       it->updateWeights(inputs, learning_rate);
     }
+    std::fill(dirty.begin(), dirty.end(), true);
     if(next) {
       // DON'T update the output after adjusting weights, first adjust all other weights
-      next->updateWeights(this->output, learning_rate);
+      next->updateWeights(Output(), learning_rate);
     }
   }
 
   bool Layer::write(ostream &s) const {
-    if (!s.good()) return false;
-    s << "LAYER\n"
-      << "inputs " << input_count << "\n"
-      << "neurons "     << size() << "\n";
-    bool success = true;
-    for (vector<Neuron>::const_iterator it = neurons.begin(); it != neurons.end(); it++) {
+    bool success = writeHeader(s, input_count, size());
+    for (arena_vector<Neuron>::const_iterator it = neurons.begin(); it != neurons.end(); it++) {
       success &= it->write(s);
     }
     return success;
   }
 
+  bool Layer::writeHeader(ostream &s, int inputs, int neurons) {
+    if (!s.good()) return false;
+    s << "LAYER\n"
+      << "inputs " << inputs << "\n"
+      << "neurons "     << neurons << "\n";
+    return s.good();
+  }
+
+  size_t Layer::parameterCount() const {
+    size_t count = 0;
+    for (arena_vector<Neuron>::const_iterator it = neurons.begin(); it != neurons.end(); it++) {
+      count += it->Weights().size();
+    }
+    return count;
+  }
+
+  void Layer::copyParameters(double* dst) const {
+    for (arena_vector<Neuron>::const_iterator it = neurons.begin(); it != neurons.end(); it++) {
+      dst = std::copy(it->Weights().begin(), it->Weights().end(), dst);
+    }
+  }
+
+  void Layer::loadParameters(const double* src) {
+    for (arena_vector<Neuron>::iterator it = neurons.begin(); it != neurons.end(); it++) {
+      it->setWeights(src);
+      src += it->Weights().size();
+    }
+    std::fill(dirty.begin(), dirty.end(), true);
+  }
+
+  void Layer::setWeights(int i, const double* w) {
+    neurons[i].setWeights(w);
+    dirty[i] = true;
+  }
+
+  void Layer::relocate(shared_ptr<Arena> arena) {
+    // Neuron objects first, so the per-neuron output and delta values are packed together...
+    arena_vector<Neuron> moved((ArenaAllocator<Neuron>(arena)));
+    moved.reserve(neurons.size());
+    moved.insert(moved.end(), neurons.begin(), neurons.end());
+    // ...followed by each Neuron's weights...
+    ArenaAllocator<double> alloc(arena);
+    for (arena_vector<Neuron>::iterator it = moved.begin(); it != moved.end(); it++) {
+      it->relocate(alloc);
+    }
+    neurons = std::move(moved);
+    // ...and the output buffer, sized up front so updateOutputs() never reallocates it
+    arena_vector<double> buffer(alloc);
+    buffer.reserve(neurons.size());
+    buffer.insert(buffer.end(), output.begin(), output.end());
+    output = std::move(buffer);
+    updateRows();
+  }
+
+  size_t Layer::arenaBytes(const Arena &arena) const {
+    size_t bytes = arena.align(neurons.size() * sizeof(Neuron));
+    for (arena_vector<Neuron>::const_iterator it = neurons.begin(); it != neurons.end(); it++) {
+      bytes += it->arenaBytes(arena);
+    }
+    return bytes + arena.align(neurons.size() * sizeof(double));
+  }
+
   void Layer::init_neurons(int neuron_count, int inputs) {
     for (int i = 0; i < neuron_count; i++) {
       // emplace_back calls the constructor inside the vector, avoiding copies
       neurons.emplace_back(inputs);
     }
+    dirty.assign(neurons.size(), true);
+    updateRows();
   }
   void Layer::init_neurons(vector<vector<double> > neuron_data) {
     for (vector<vector<double> >::iterator it = neuron_data.begin(); it != neuron_data.end(); it++) {
-      assert(it->size() == input_count);
+      // input weights plus the bias weight
+      assert((int) it->size() == input_count + 1);
       neurons.emplace_back(*it);
     }
+    dirty.assign(neurons.size(), true);
+    updateRows();
+  }
+
+  void Layer::updateRows() {
+    rows.resize(neurons.size());
+    for (size_t i = 0; i < neurons.size(); i++) {
+      rows[i] = neurons[i].Weights().data();
+    }
   }
 
   vector<Neuron> Layer::readNeurons(istream &s, int count) {
@@ -1,5 +1,7 @@
 #include "neural/Network.h"
+#include "neural/Tuner.h"
 #include <cassert>
+#include <algorithm>
 
 namespace neural {
   Network::Network(int input, int output, vector<int> hidden) :
@@ -111,36 +113,54 @@ namespace neural {
   }
 
   double Network::trainSingle(vector<double> input, vector<double> expected_output, double learning_rate) {
+    trainStep(input, expected_output, learning_rate);
+
+    // Calculate outputs with updated weights
+    firstLayer()->updateOutputs(inputLayer);
+    return calculateError(expected_output);
+  }
+
+  double Network::trainStep(const vector<double> &input, const vector<double> &expected_output, double learning_rate) {
     assert(input.size() == inputLayer.size());
     assert(expected_output.size() == outputLayer->size());
     inputLayer = input;
-    shared_ptr<Layer> startLayer;
-    if (firstHidden) {
-      startLayer = firstHidden;
-    } else {
-      startLayer = outputLayer;
-    }
+    shared_ptr<Layer> startLayer = firstLayer();
 
     startLayer->updateOutputs(inputLayer);
+    double mse = calculateError(expected_output);
+    vector<double> output = outputLayer->Output();
     vector<double> deltas;
     for( int i = 0; i < outputLayer->size(); i++) {
-      deltas.push_back(expected_output[i] - outputLayer->Output()[i]);
+      deltas.push_back(expected_output[i] - output[i]);
     }
     outputLayer->updateDeltas(deltas);
     startLayer->updateWeights(inputLayer, learning_rate);
+    if (cache) cache->invalidate();
+    return mse;
+  }
 
-    // Calculate outputs with updated weights
-    startLayer->updateOutputs(inputLayer);
-
+  double Network::calculateError(const vector<double> &expected_output) const {
     // Calculate mean squared error
+    vector<double> output = outputLayer->Output();
     double mse = 0.0;
     for( int i = 0; i < outputLayer->size(); i++) {
-      mse += (expected_output[i] - outputLayer->Output()[i]) * (expected_output[i] - outputLayer->Output()[i]);
+      mse += (expected_output[i] - output[i]) * (expected_output[i] - output[i]);
     }
     return mse / (double) outputLayer->size();
   }
 
   vector<double> Network::run(vector<double> input) {
+    if (cache) {
+      vector<double> output;
+      // Read before computing, so output from weights that change meanwhile is never stored as current
+      unsigned long generation = cache->Generation();
+      if (!cache->lookup(input, output)) {
+	// Leave the layers alone, so concurrent callers don't race on their outputs
+	output = runBatch(vector<vector<double> >(1, input)).front();
+	cache->insert(input, output, generation);
+      }
+      return output;
+    }
     shared_ptr<Layer> startLayer;
     if (firstHidden) {
       startLayer = firstHidden;
@@ -151,6 +171,35 @@ namespace neural {
     return outputLayer->Output();
   }
 
+  vector<vector<double> > Network::runBatch(const vector<vector<double> > &inputs) const {
+    size_t batch = inputs.size();
+    if (batch == 0) {
+      return vector<vector<double> >();
+    }
+    vector<double> current(batch * inputLayer.size());
+    for (size_t b = 0; b < batch; b++) {
+      assert(inputs[b].size() == inputLayer.size());
+      std::copy(inputs[b].begin(), inputs[b].end(), current.begin() + b * inputLayer.size());
+    }
+    vector<double> next;
+    for (shared_ptr<Layer> layer = firstLayer(); layer; layer = layer->nextLayer()) {
+      next.resize(batch * layer->size());
+      layer->forwardBatch(current.data(), batch, next.data());
+      current.swap(next);
+    }
+    vector<vector<double> > outputs(batch);
+    for (size_t b = 0; b < batch; b++) {
+      outputs[b].assign(current.begin() + b * outputLayer->size(), current.begin() + (b + 1) * outputLayer->size());
+    }
+    return outputs;
+  }
+
+  void Network::tune(size_t batch) {
+    for (shared_ptr<Layer> current = firstLayer(); current; current = current->nextLayer()) {
+      current->setKernel(batch, Tuner::instance().tune(*current, batch));
+    }
+  }
+
   bool Network::write(string &filename) const {
     // Open file in binary mode
     ofstream file(filename.c_str(), ios_base::out | ios_base::binary);
@@ -163,25 +212,74 @@ namespace neural {
   }
 
   bool Network::write(ostream &s) const {
+    // Write hidden layers, followed by the output layer
+    bool success = writeHeader(s, inputLayer.size(), layerCount);
+    for (shared_ptr<Layer> current = firstLayer(); current; current = current->nextLayer()) {
+      success &= current->write(s);
+    }
+    return success;
+  }
+
+  bool Network::writeHeader(ostream &s, int inputs, int layers) {
     if (!s.good() ) {
       return false;
     }
     s << "NETWORK" << "\n"
-      << "input_size " << inputLayer.size() << "\n"
-      << "layers " << layerCount << "\n";
-    shared_ptr<Layer> currentLayer;
-    if (firstHidden) {
-      currentLayer = firstHidden;
-    } else {
-      currentLayer = outputLayer;
-    }
-    // Write hidden layers
-    do {
-      currentLayer->write(s);
-      currentLayer = currentLayer->nextLayer();
-    } while (currentLayer->nextLayer());
-    // Write output layer
-    outputLayer->write(s);
+      << "input_size " << inputs << "\n"
+      << "layers " << layers << "\n";
+    return s.good();
+  }
+
+  size_t Network::parameterCount() const {
+    size_t count = 0;
+    for (shared_ptr<Layer> current = firstLayer(); current; current = current->nextLayer()) {
+      count += current->parameterCount();
+    }
+    return count;
+  }
+
+  void Network::copyParameters(double* dst) const {
+    for (shared_ptr<Layer> current = firstLayer(); current; current = current->nextLayer()) {
+      current->copyParameters(dst);
+      dst += current->parameterCount();
+    }
+  }
+
+  void Network::loadParameters(const double* src) {
+    for (shared_ptr<Layer> current = firstLayer(); current; current = current->nextLayer()) {
+      current->loadParameters(src);
+      src += current->parameterCount();
+    }
+    if (cache) cache->invalidate();
+  }
+
+  void Network::applyGradients(const double* gradients, double scale) {
+    for (shared_ptr<Layer> current = firstLayer(); current; current = current->nextLayer()) {
+      current->applyGradients(gradients, scale);
+      gradients += current->parameterCount();
+    }
+    if (cache) cache->invalidate();
+  }
+
+  void Network::enableCache(size_t capacity, int shards, double quantum) {
+    cache = shared_ptr<InferenceCache>(new InferenceCache(capacity, shards, quantum));
+  }
+
+  bool Network::useArena(bool huge_pages, size_t alignment) {
+    // Size the Arena with an empty one -- only its alignment matters here
+    Arena sizing(0, alignment, false);
+    size_t bytes = 0;
+    for (shared_ptr<Layer> current = firstLayer(); current; current = current->nextLayer()) {
+      bytes += current->arenaBytes(sizing);
+    }
+    shared_ptr<Arena> a(new Arena(bytes, alignment, huge_pages));
+    if (a->Capacity() < bytes) {
+      return false;
+    }
+    for (shared_ptr<Layer> current = firstLayer(); current; current = current->nextLayer()) {
+      current->relocate(a);
+    }
+    arena = a;
     return true;
   }
 }
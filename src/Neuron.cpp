@@ -76,22 +76,34 @@ namespace neural {
     weights[weights.size() - 1] = delta * learning_rate;
   }
 
+  void Neuron::applyGradients(const double* gradients, double scale) {
+    for (size_t i = 0; i < weights.size(); i++) {
+      weights[i] += gradients[i] * scale;
+    }
+  }
+
   bool Neuron::write(std::ostream &s) const {
-    assert(sizeof(double) == sizeof(char*));
+    return write(s, weights.data(), weights.size(), sizeof(double));
+  }
+
+  bool Neuron::write(std::ostream &s, const void* weights, size_t size, size_t weight_bytes) {
     if ( !s.good() ) return false;
     s << "NEURON" << "\n"
-      << "size " << weights.size() << "\n"
+      << "size " << size << "\n"
       << "data ";
-    double current = 0.0;
-    for ( int i = 0; i < weights.size(); i++) {
-      current = weights[i];
-      s.write(reinterpret_cast<char*>(&current), sizeof(current));
-      if (!s.good()) {
-	return false;
-      }
-    }
-    s << std::endl;
-    return true;
+    s.write(static_cast<const char*>(weights), size * weight_bytes);
+    // No std::endl here -- flushing after every Neuron makes writing large networks very slow
+    s << '\n';
+    return s.good();
+  }
+
+  void Neuron::relocate(const ArenaAllocator<double> &alloc) {
+    arena_vector<double> moved(weights.begin(), weights.end(), alloc);
+    weights = std::move(moved);
+  }
+
+  size_t Neuron::arenaBytes(const Arena &arena) const {
+    return arena.align(weights.size() * sizeof(double));
   }
 
   void Neuron::initWeightsRandom(int inputSize) {
@@ -0,0 +1,128 @@
+#include "neural/ParameterStore.h"
+#include <algorithm>
+
+namespace neural {
+  ParameterStore::Pin::Pin(Hazard* h, const Snapshot* s) :
+    hazard(h),
+    snapshot(s)
+  {}
+
+  ParameterStore::Pin::Pin(Pin &&other) :
+    hazard(other.hazard),
+    snapshot(other.snapshot)
+  {
+    other.hazard = NULL;
+    other.snapshot = NULL;
+  }
+
+  ParameterStore::Pin::~Pin() {
+    if (hazard) {
+      hazard->snapshot.store(NULL);
+      hazard->active.store(false);
+    }
+  }
+
+  ParameterStore::ParameterStore(const Network &net) :
+    current(new Snapshot(net)),
+    hazards(NULL),
+    version(1)
+  {
+    current.load()->version = version.load();
+  }
+
+  ParameterStore::~ParameterStore() {
+    delete current.load();
+    for (size_t i = 0; i < retired.size(); i++) {
+      delete retired[i];
+    }
+    for (size_t i = 0; i < spare.size(); i++) {
+      delete spare[i];
+    }
+    Hazard* h = hazards.load();
+    while (h) {
+      Hazard* next = h->next;
+      delete h;
+      h = next;
+    }
+  }
+
+  ParameterStore::Hazard* ParameterStore::acquireHazard() const {
+    // Reuse an idle record if there is one...
+    for (Hazard* h = hazards.load(); h; h = h->next) {
+      bool idle = false;
+      if (!h->active.load() && h->active.compare_exchange_strong(idle, true)) {
+	return h;
+      }
+    }
+    // ...otherwise push a new one onto the list
+    Hazard* h = new Hazard();
+    h->active.store(true);
+    Hazard* head = hazards.load();
+    do {
+      h->next = head;
+    } while (!hazards.compare_exchange_weak(head, h));
+    return h;
+  }
+
+  ParameterStore::Pin ParameterStore::pin() const {
+    Hazard* h = acquireHazard();
+    const Snapshot* s = current.load();
+    // Announce s, then make sure it is still current -- otherwise publish() may already have
+    // missed our announcement and be about to recycle it
+    while (true) {
+      h->snapshot.store(s);
+      const Snapshot* again = current.load();
+      if (again == s) break;
+      s = again;
+    }
+    return Pin(h, s);
+  }
+
+  vector<double> ParameterStore::run(const vector<double> &input) const {
+    Pin p = pin();
+    return p->run(input);
+  }
+
+  unsigned long ParameterStore::publish(const Network &net) {
+    lock_guard<mutex> lock(publish_mutex);
+    Snapshot* next;
+    if (spare.empty()) {
+      next = new Snapshot(net);
+    } else {
+      next = spare.back();
+      spare.pop_back();
+      next->capture(net);
+    }
+    next->version = version.load() + 1;
+    retired.push_back(current.exchange(next));
+    version.store(next->version);
+    reclaim();
+    return next->version;
+  }
+
+  unsigned long ParameterStore::Version() const {
+    return version.load();
+  }
+
+  void ParameterStore::reclaim() {
+    vector<const Snapshot*> pinned;
+    for (Hazard* h = hazards.load(); h; h = h->next) {
+      const Snapshot* s = h->snapshot.load();
+      if (s) pinned.push_back(s);
+    }
+    vector<Snapshot*> still_pinned;
+    for (size_t i = 0; i < retired.size(); i++) {
+      if (std::find(pinned.begin(), pinned.end(), retired[i]) != pinned.end()) {
+	still_pinned.push_back(retired[i]);
+      } else {
+	spare.push_back(retired[i]);
+      }
+    }
+    retired.swap(still_pinned);
+    // One spare is enough to avoid allocations on every publish()
+    while (spare.size() > 1) {
+      delete spare.back();
+      spare.pop_back();
+    }
+  }
+}
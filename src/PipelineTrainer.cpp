@@ -0,0 +1,260 @@
+#include "neural/PipelineTrainer.h"
+#include <algorithm>
+#include <cassert>
+
+namespace neural {
+  namespace {
+    //! Number of times an idle stage yields before it goes to sleep
+    const int SPIN_LIMIT = 64;
+  }
+
+  PipelineTrainer::PipelineTrainer(Network &n, int stage_count, size_t mb, size_t in_flight) :
+    net(n),
+    micro_batch(mb < 1 ? 1 : mb),
+    batch_inputs(NULL),
+    batch_targets(NULL),
+    micro_batches(0),
+    error(0.0),
+    generation(0),
+    running(0),
+    stopping(false)
+  {
+    vector<shared_ptr<Layer> > layers;
+    size_t total = 0;
+    for (shared_ptr<Layer> current = net.firstLayer(); current; current = current->nextLayer()) {
+      layers.push_back(current);
+      total += current->parameterCount();
+    }
+    size_t count = std::max(1, std::min(stage_count, (int) layers.size()));
+    max_in_flight = in_flight > 0 ? in_flight : 2 * count;
+    gradients.assign(total, 0.0);
+
+    // Hand out consecutive layers until each stage has about its share of the weights,
+    // leaving at least one layer for each of the remaining stages
+    size_t l = 0;
+    size_t assigned = 0;
+    for (size_t s = 0; s < count; s++) {
+      // Every message in a queue belongs to a different micro-batch in flight, so they never fill up
+      unique_ptr<Stage> stage(new Stage(max_in_flight));
+      size_t target = total * (s + 1) / count;
+      do {
+	stage->layers.push_back(layers[l]);
+	stage->offsets.push_back(assigned);
+	assigned += layers[l]->parameterCount();
+	l++;
+      } while (l < layers.size() && layers.size() - l > count - s - 1 &&
+	       (s + 1 == count || assigned + layers[l]->parameterCount() / 2 <= target));
+      stages.push_back(std::move(stage));
+    }
+    assert(l == layers.size());
+
+    for (size_t s = 0; s < stages.size(); s++) {
+      stages[s]->worker = thread(&PipelineTrainer::work, this, s);
+    }
+  }
+
+  PipelineTrainer::~PipelineTrainer() {
+    {
+      lock_guard<mutex> lock(m);
+      stopping = true;
+    }
+    start_cv.notify_all();
+    for (size_t s = 0; s < stages.size(); s++) {
+      stages[s]->worker.join();
+    }
+  }
+
+  double PipelineTrainer::trainBatch(const vector<vector<double> > &inputs, const vector<vector<double> > &targets,
+				     double learning_rate) {
+    assert(inputs.size() == targets.size());
+    if (inputs.empty()) {
+      return 0.0;
+    }
+    {
+      unique_lock<mutex> lock(m);
+      batch_inputs = &inputs;
+      batch_targets = &targets;
+      micro_batches = (inputs.size() + micro_batch - 1) / micro_batch;
+      error = 0.0;
+      running = stages.size();
+      generation++;
+      start_cv.notify_all();
+      while (running > 0) {
+	done_cv.wait(lock);
+      }
+    }
+    // All micro-batches saw the same weights -- now apply their mean update in one go
+    net.applyGradients(gradients.data(), learning_rate / inputs.size());
+    std::fill(gradients.begin(), gradients.end(), 0.0);
+    return error / inputs.size();
+  }
+
+  void PipelineTrainer::work(size_t s) {
+    unsigned long seen = 0;
+    while (true) {
+      {
+	unique_lock<mutex> lock(m);
+	while (!stopping && generation == seen) {
+	  start_cv.wait(lock);
+	}
+	if (stopping) return;
+	seen = generation;
+      }
+      runStage(s);
+      {
+	lock_guard<mutex> lock(m);
+	if (--running == 0) {
+	  done_cv.notify_all();
+	}
+      }
+    }
+  }
+
+  void PipelineTrainer::runStage(size_t s) {
+    Stage &stage = *stages[s];
+    bool last = s + 1 == stages.size();
+    size_t forwards = 0;
+    size_t backwards = 0;
+    // Only tracked by the first stage, which decides when the next micro-batch may enter the pipeline
+    size_t in_flight = 0;
+    Message msg;
+    int spins = 0;
+    while (backwards < micro_batches) {
+      // Read before looking at the queues, so a message arriving after the check still ends sleep()
+      unsigned long seen = stage.wakeups.load();
+      // Backward first: it finishes micro-batches and frees their stashed activations
+      if (!last && stage.backward_in.pop(msg)) {
+	wake(s + 1);
+	spins = 0;
+	backward(s, msg);
+	backwards++;
+	if (s == 0) in_flight--;
+	continue;
+      }
+      bool have_forward = false;
+      if (s == 0) {
+	if (forwards < micro_batches && in_flight < max_in_flight) {
+	  size_t first = forwards * micro_batch;
+	  size_t end = std::min(first + micro_batch, batch_inputs->size());
+	  msg.id = forwards;
+	  msg.count = end - first;
+	  msg.data.clear();
+	  for (size_t i = first; i < end; i++) {
+	    msg.data.insert(msg.data.end(), (*batch_inputs)[i].begin(), (*batch_inputs)[i].end());
+	  }
+	  have_forward = true;
+	  in_flight++;
+	}
+      } else if (stage.forward_in.pop(msg)) {
+	wake(s - 1);
+	have_forward = true;
+      }
+      if (have_forward) {
+	spins = 0;
+	forward(s, msg);
+	forwards++;
+	if (last) {
+	  // forward() turned msg into the output error -- back-propagate right away
+	  backward(s, msg);
+	  backwards++;
+	  if (s == 0) in_flight--;
+	}
+	continue;
+      }
+      if (++spins < SPIN_LIMIT) {
+	this_thread::yield();
+      } else {
+	sleep(s, seen);
+	spins = 0;
+      }
+    }
+  }
+
+  void PipelineTrainer::forward(size_t s, Message &msg) {
+    Stage &stage = *stages[s];
+    vector<vector<double> > &acts = stage.stash[msg.id];
+    acts.resize(stage.layers.size() + 1);
+    acts[0].swap(msg.data);
+    for (size_t k = 0; k < stage.layers.size(); k++) {
+      acts[k + 1].resize(msg.count * stage.layers[k]->size());
+      stage.layers[k]->forwardBatch(acts[k].data(), msg.count, acts[k + 1].data());
+    }
+    const vector<double> &out = acts.back();
+    if (s + 1 < stages.size()) {
+      msg.data.assign(out.begin(), out.end());
+      send(s, s + 1, stages[s + 1]->forward_in, msg);
+      return;
+    }
+    // Last stage: the summed weighed deltas of the output layer are just the errors
+    size_t outputs = stage.layers.back()->size();
+    msg.data.resize(out.size());
+    for (size_t b = 0; b < msg.count; b++) {
+      const vector<double> &expected = (*batch_targets)[msg.id * micro_batch + b];
+      assert(expected.size() == outputs);
+      double mse = 0.0;
+      for (size_t i = 0; i < outputs; i++) {
+	double diff = expected[i] - out[b * outputs + i];
+	msg.data[b * outputs + i] = diff;
+	mse += diff * diff;
+      }
+      error += mse / outputs;
+    }
+  }
+
+  void PipelineTrainer::backward(size_t s, Message &msg) {
+    Stage &stage = *stages[s];
+    map<size_t, vector<vector<double> > >::iterator it = stage.stash.find(msg.id);
+    assert(it != stage.stash.end());
+    vector<vector<double> > &acts = it->second;
+    vector<double> deltas;
+    deltas.swap(msg.data);
+    vector<double> prev_deltas;
+    for (size_t k = stage.layers.size(); k-- > 0; ) {
+      const Layer &layer = *stage.layers[k];
+      // The first stage's first layer has nobody to pass deltas to
+      bool propagate = k > 0 || s > 0;
+      prev_deltas.resize(propagate ? msg.count * layer.Inputs() : 0);
+      layer.backwardBatch(acts[k].data(), acts[k + 1].data(), deltas.data(), msg.count,
+			  propagate ? prev_deltas.data() : NULL, gradients.data() + stage.offsets[k]);
+      deltas.swap(prev_deltas);
+    }
+    stage.stash.erase(it);
+    if (s > 0) {
+      msg.data.swap(deltas);
+      send(s, s - 1, stages[s - 1]->backward_in, msg);
+    }
+  }
+
+  void PipelineTrainer::send(size_t s, size_t to, SpscQueue<Message> &queue, Message &msg) {
+    int spins = 0;
+    while (true) {
+      unsigned long seen = stages[s]->wakeups.load();
+      if (queue.push(msg)) break;
+      // Full -- the receiving stage wakes us once it pops a message
+      if (++spins < SPIN_LIMIT) {
+	this_thread::yield();
+      } else {
+	sleep(s, seen);
+	spins = 0;
+      }
+    }
+    wake(to);
+  }
+
+  void PipelineTrainer::wake(size_t s) {
+    Stage &stage = *stages[s];
+    {
+      lock_guard<mutex> lock(stage.wake_m);
+      stage.wakeups++;
+    }
+    stage.wake_cv.notify_one();
+  }
+
+  void PipelineTrainer::sleep(size_t s, unsigned long seen) {
+    Stage &stage = *stages[s];
+    unique_lock<mutex> lock(stage.wake_m);
+    while (stage.wakeups.load() == seen) {
+      stage.wake_cv.wait(lock);
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#include "neural/Snapshot.h"
+#include <cassert>
+
+namespace neural {
+  Snapshot::Snapshot() :
+    input_count(0),
+    version(0)
+  {}
+
+  Snapshot::Snapshot(const Network &net) :
+    input_count(0),
+    version(0)
+  {
+    capture(net);
+  }
+
+  void Snapshot::capture(const Network &net) {
+    input_count = net.Inputs();
+    sizes.clear();
+    activations.clear();
+    params.resize(net.parameterCount());
+    net.copyParameters(params.data());
+    for (shared_ptr<Layer> current = net.firstLayer(); current; current = current->nextLayer()) {
+      sizes.push_back(current->size());
+      for (int i = 0; i < current->size(); i++) {
+	activations.push_back(current->neuron(i).Activation());
+      }
+    }
+  }
+
+  vector<double> Snapshot::run(const vector<double> &input) const {
+    assert((int) input.size() == input_count);
+    vector<double> current(input);
+    vector<double> next;
+    const double* w = params.data();
+    size_t neuron_index = 0;
+    for (size_t l = 0; l < sizes.size(); l++) {
+      next.resize(sizes[l]);
+      for (int i = 0; i < sizes[l]; i++) {
+	double sum = w[current.size()]; // bias
+	for (size_t j = 0; j < current.size(); j++) {
+	  sum += current[j] * w[j];
+	}
+	next[i] = activations[neuron_index++](sum);
+	w += current.size() + 1;
+      }
+      current.swap(next);
+    }
+    return current;
+  }
+
+  bool Snapshot::write(ostream &s) const {
+    bool success = Network::writeHeader(s, input_count, sizes.size());
+    const double* w = params.data();
+    int inputs = input_count;
+    for (size_t l = 0; success && l < sizes.size(); l++) {
+      success &= Layer::writeHeader(s, inputs, sizes[l]);
+      for (int i = 0; success && i < sizes[l]; i++) {
+	success &= Neuron::write(s, w, inputs + 1, sizeof(double));
+	w += inputs + 1;
+      }
+      inputs = sizes[l];
+    }
+    return success;
+  }
+}
@@ -0,0 +1,96 @@
+#include "neural/Trainer.h"
+#include <algorithm>
+#include <cassert>
+
+namespace neural {
+  Trainer::Trainer(Network &n) :
+    net(n),
+    learning_rate(0.3),
+    max_epochs(100),
+    validation_interval(1),
+    validation_batch(64),
+    patience(5),
+    min_improvement(0.0),
+    epochs(0),
+    best_epoch(0),
+    stopped(false)
+  {}
+
+  double Trainer::train(const vector<vector<double> > &inputs, const vector<vector<double> > &targets,
+			const vector<vector<double> > &validation_inputs,
+			const vector<vector<double> > &validation_targets) {
+    assert(inputs.size() == targets.size());
+    assert(validation_inputs.size() == validation_targets.size());
+    bool validating = !validation_inputs.empty();
+    epochs = 0;
+    best_epoch = 0;
+    stopped = false;
+    training_errors.clear();
+    if (inputs.empty()) {
+      return 0.0;
+    }
+
+    order.resize(inputs.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    vector<double> best_params;
+    double best_error = -1.0;
+    int checks_without_improvement = 0;
+
+    while (epochs < max_epochs) {
+      shuffle(order.begin(), order.end(), rng);
+      double error = 0.0;
+      for (size_t i = 0; i < order.size(); i++) {
+	error += net.trainStep(inputs[order[i]], targets[order[i]], learning_rate);
+      }
+      error /= order.size();
+      training_errors.push_back(error);
+      epochs++;
+
+      if (epochs % validation_interval != 0 && epochs < max_epochs) {
+	continue;
+      }
+      if (validating) {
+	error = validate(validation_inputs, validation_targets);
+      }
+      if (best_error < 0 || error < best_error - min_improvement) {
+	best_error = error;
+	best_epoch = epochs;
+	checks_without_improvement = 0;
+	best_params.resize(net.parameterCount());
+	net.copyParameters(best_params.data());
+      } else if (patience > 0 && ++checks_without_improvement >= patience) {
+	stopped = true;
+	break;
+      }
+    }
+    if (best_epoch != epochs) {
+      net.loadParameters(best_params.data());
+    }
+    return best_error;
+  }
+
+  double Trainer::validate(const vector<vector<double> > &inputs, const vector<vector<double> > &targets) const {
+    assert(inputs.size() == targets.size());
+    if (inputs.empty()) {
+      return 0.0;
+    }
+    double error = 0.0;
+    vector<vector<double> > chunk;
+    for (size_t start = 0; start < inputs.size(); start += validation_batch) {
+      size_t end = min(start + validation_batch, inputs.size());
+      chunk.assign(inputs.begin() + start, inputs.begin() + end);
+      vector<vector<double> > outputs = net.runBatch(chunk);
+      for (size_t b = 0; b < outputs.size(); b++) {
+	const vector<double> &expected = targets[start + b];
+	double mse = 0.0;
+	for (size_t i = 0; i < expected.size(); i++) {
+	  mse += (expected[i] - outputs[b][i]) * (expected[i] - outputs[b][i]);
+	}
+	error += mse / expected.size();
+      }
+    }
+    return error / inputs.size();
+  }
+}
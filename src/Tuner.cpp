@@ -0,0 +1,195 @@
+#include "neural/Tuner.h"
+#include "FileIO.h"
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#define NEURAL_HAVE_FLOCK
+#endif
+
+namespace neural {
+  namespace {
+    //! Minimum time to spend measuring each candidate
+    const double MEASURE_SECONDS = 0.005;
+  }
+
+  Tuner& Tuner::instance() {
+    static Tuner tuner;
+    return tuner;
+  }
+
+  Tuner::Tuner() :
+    machine(machineIdentity()),
+    has_override(false)
+  {
+    const char* file = getenv("NEURAL_TUNING_FILE");
+    const char* home = getenv("HOME");
+    if (file && *file) {
+      path = file;
+    } else if (home && *home) {
+      path = string(home) + "/.neural_tuning";
+    } else {
+      path = ".neural_tuning";
+    }
+    const char* forced = getenv("NEURAL_KERNEL");
+    if (forced && *forced) {
+      has_override = KernelConfig::parse(forced, override_config);
+      if (!has_override) {
+	cerr << "Ignoring invalid NEURAL_KERNEL setting " << forced << endl;
+      }
+    }
+    load(cache);
+  }
+
+  KernelConfig Tuner::tune(const Layer &layer, size_t batch) {
+    if (has_override) {
+      return override_config;
+    }
+    KernelConfig config;
+    if (lookup(layer.size(), layer.Inputs(), batch, config)) {
+      return config;
+    }
+    // Benchmark without holding the lock -- at worst two threads tune the same shape
+    config = benchmark(layer, batch);
+    lock_guard<mutex> lock(m);
+    cache[Shape(machine, layer.size(), layer.Inputs(), batch)] = config;
+    if (!save()) {
+      cerr << "Could not write tuning file " << path << endl;
+    }
+    return config;
+  }
+
+  bool Tuner::lookup(size_t rows, size_t cols, size_t batch, KernelConfig &config) {
+    lock_guard<mutex> lock(m);
+    map<Shape, KernelConfig>::const_iterator it = cache.find(Shape(machine, rows, cols, batch));
+    if (it == cache.end()) {
+      return false;
+    }
+    config = it->second;
+    // Never start more threads than this machine has, even if the file was edited or copied
+    int max_threads = thread::hardware_concurrency();
+    if (max_threads > 0 && config.threads > max_threads) {
+      config.threads = max_threads;
+    }
+    return true;
+  }
+
+  void Tuner::load(map<Shape, KernelConfig> &into) const {
+    ifstream file(path.c_str());
+    string line;
+    while (getline(file, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      istringstream fields(line);
+      string id, name;
+      size_t rows, cols, batch;
+      KernelConfig config;
+      if (fields >> id >> rows >> cols >> batch >> name && KernelConfig::parse(name, config)) {
+	into[Shape(id, rows, cols, batch)] = config;
+      }
+    }
+  }
+
+  bool Tuner::save() {
+#ifdef NEURAL_HAVE_FLOCK
+    // Serialize read-merge-write with other processes tuning at the same time
+    string lock_name = path + ".lock";
+    int lock_fd = open(lock_name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock_fd >= 0) {
+      flock(lock_fd, LOCK_EX);
+    }
+#endif
+    // Keep shapes other processes have tuned since we loaded the file -- our own results take precedence
+    map<Shape, KernelConfig> on_disk;
+    load(on_disk);
+    cache.insert(on_disk.begin(), on_disk.end());
+
+    ostringstream data;
+    data << "# neural kernel tuning cache: machine rows cols batch kernel\n";
+    for (map<Shape, KernelConfig>::const_iterator it = cache.begin(); it != cache.end(); it++) {
+      data << it->first.machine << " " << it->first.rows << " " << it->first.cols << " " << it->first.batch << " "
+	   << it->second.toString() << "\n";
+    }
+    // Goes through a temporary file of our own, so concurrently starting processes never read half a file
+    bool success = writeDurably(path, data.str());
+#ifdef NEURAL_HAVE_FLOCK
+    if (lock_fd >= 0) {
+      close(lock_fd);
+    }
+#endif
+    return success;
+  }
+
+  KernelConfig Tuner::benchmark(const Layer &layer, size_t batch) const {
+    typedef chrono::steady_clock clock;
+    vector<double> in(batch * layer.Inputs());
+    for (size_t i = 0; i < in.size(); i++) {
+      in[i] = ((double) rand()) / RAND_MAX - 0.5;
+    }
+    vector<double> out(batch * layer.size());
+
+    vector<KernelConfig> candidates;
+    int max_threads = thread::hardware_concurrency();
+    for (int v = KernelConfig::SCALAR; v <= KernelConfig::BLOCKED; v++) {
+      for (int t = 1; t == 1 || t <= max_threads; t *= 2) {
+	candidates.push_back(KernelConfig(static_cast<KernelConfig::Variant>(v), t));
+      }
+    }
+
+    KernelConfig best;
+    double best_time = -1.0;
+    for (size_t c = 0; c < candidates.size(); c++) {
+      // Warm up caches, then time as many runs as fit into MEASURE_SECONDS
+      layer.weightedSums(in.data(), batch, out.data(), candidates[c]);
+      int runs = 0;
+      clock::time_point start = clock::now();
+      double elapsed = 0.0;
+      do {
+	layer.weightedSums(in.data(), batch, out.data(), candidates[c]);
+	runs++;
+	elapsed = chrono::duration<double>(clock::now() - start).count();
+      } while (elapsed < MEASURE_SECONDS);
+      double per_run = elapsed / runs;
+      if (best_time < 0 || per_run < best_time) {
+	best_time = per_run;
+	best = candidates[c];
+      }
+    }
+    return best;
+  }
+
+  string Tuner::machineIdentity() {
+    string model;
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (model.empty() && getline(cpuinfo, line)) {
+      // x86 has "model name", some ARM kernels only "Processor" or "CPU part"
+      if (line.compare(0, 10, "model name") == 0 || line.compare(0, 9, "Processor") == 0 ||
+	  line.compare(0, 8, "CPU part") == 0) {
+	size_t colon = line.find(':');
+	if (colon != string::npos) {
+	  size_t start = line.find_first_not_of(" \t", colon + 1);
+	  if (start != string::npos) model = line.substr(start);
+	}
+      }
+    }
+    if (model.empty()) {
+      model = "unknown";
+    }
+    // The identity is the first field of a line in the tuning file
+    for (size_t i = 0; i < model.size(); i++) {
+      if (isspace((unsigned char) model[i])) model[i] = '_';
+    }
+    ostringstream id;
+    id << model << "/" << thread::hardware_concurrency();
+    return id.str();
+  }
+}